@@ -0,0 +1,233 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+
+// what push does when the queue is full
+enum QueueFullPolicy
+{
+    QUEUE_DROP_OLDEST = 0, // the oldest queued item is discarded to make room, the consumer sees the freshest items
+    QUEUE_DROP_NEWEST = 1, // the pushed item is discarded
+    QUEUE_BLOCK = 2 // push waits until the consumer has taken an item
+};
+
+struct QueueConfig
+{
+    int capacity;
+    QueueFullPolicy policy;
+};
+
+// bounded ring queue handing items from one stage thread to the next. Every slot carries a sequence
+// number telling whose turn it is (the bounded queue of D. Vyukov), so a slot is only written once the
+// reader is done with it and no lock is taken on push/pop. The producer may also pop, which is how
+// QUEUE_DROP_OLDEST makes room without racing the consumer on the slot it is reading. For the same
+// reason it stays correct with several producers or consumers, e.g. inference workers sharing one output.
+// The mutex/condition pair is only used to park a thread waiting on a full or empty queue.
+template<typename T>
+class BoundedQueue
+{
+public:
+    BoundedQueue(int capacity, QueueFullPolicy policy)
+        : capacity(capacity > 0 ? capacity : 1), policy(policy), slots(new Slot[capacity > 0 ? capacity : 1]),
+          head(0), tail(0), closed(false), waiters(0), dropped(0)
+    {
+        for (size_t i = 0; i < this->capacity; i++)
+            this->slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // hands item to the consumer following the full policy, item is moved from.
+    // false if the item (not an older one) was dropped or the queue is closed
+    bool push(T& item)
+    {
+        if (this->closed.load(std::memory_order_acquire))
+            return false;
+        if (this->try_push(item))
+            return true;
+
+        if (this->policy == QUEUE_DROP_NEWEST)
+        {
+            this->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        if (this->policy == QUEUE_DROP_OLDEST)
+        {
+            T oldest;
+            while (!this->try_push(item))
+            {
+                if (this->try_pop(oldest))
+                    this->dropped.fetch_add(1, std::memory_order_relaxed);
+                else
+                    std::this_thread::yield(); // the consumer is still taking the item in the way
+            }
+            return true;
+        }
+
+        bool pushed = false;
+        {
+            std::unique_lock<std::mutex> lock(this->wait_lock);
+            this->waiters.fetch_add(1);
+            while (!this->closed.load(std::memory_order_acquire) && !(pushed = this->enqueue(item)))
+                this->changed.wait_for(lock, std::chrono::milliseconds(10));
+            this->waiters.fetch_sub(1);
+        }
+        if (pushed)
+            this->notify();
+        return pushed;
+    }
+
+    // takes the oldest item, waiting for one. false once the queue is closed and drained
+    bool pop(T& item)
+    {
+        if (this->try_pop(item))
+            return true;
+
+        bool popped = false;
+        {
+            std::unique_lock<std::mutex> lock(this->wait_lock);
+            this->waiters.fetch_add(1);
+            while (!(popped = this->dequeue(item)) && !this->closed.load(std::memory_order_acquire))
+                this->changed.wait_for(lock, std::chrono::milliseconds(10));
+            this->waiters.fetch_sub(1);
+        }
+        if (popped)
+            this->notify();
+        return popped;
+    }
+
+    bool try_push(T& item)
+    {
+        if (!this->enqueue(item))
+            return false;
+        this->notify();
+        return true;
+    }
+
+    bool try_pop(T& item)
+    {
+        if (!this->dequeue(item))
+            return false;
+        this->notify();
+        return true;
+    }
+
+    // no more items will be pushed: push fails from now on, pop drains what is queued and then fails
+    void close()
+    {
+        this->closed.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(this->wait_lock);
+        this->changed.notify_all();
+    }
+
+    bool is_closed() const
+    {
+        return this->closed.load(std::memory_order_acquire);
+    }
+
+    // items discarded by the full policy so far
+    uint64_t dropped_count() const
+    {
+        return this->dropped.load(std::memory_order_relaxed);
+    }
+
+    int size() const
+    {
+        size_t h = this->head.load(std::memory_order_acquire);
+        size_t t = this->tail.load(std::memory_order_acquire);
+        return h > t ? (int)(h - t) : 0;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    bool enqueue(T& item)
+    {
+        size_t pos = this->head.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;)
+        {
+            slot = &this->slots[pos % this->capacity];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (this->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0)
+            {
+                return false;
+            } else
+            {
+                pos = this->head.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = std::move(item);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool dequeue(T& item)
+    {
+        size_t pos = this->tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;)
+        {
+            slot = &this->slots[pos % this->capacity];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (this->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0)
+            {
+                return false;
+            } else
+            {
+                pos = this->tail.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(slot->value);
+        // the slot must not keep the item alive (a frame buffer) until it is overwritten
+        slot->value = T();
+        slot->sequence.store(pos + this->capacity, std::memory_order_release);
+        return true;
+    }
+
+    // wakes the other side if it is parked. The fence pairs with the waiter registering itself before
+    // it retries: either the waiter sees the new state or we see the waiter, the timed wait covers the rest
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (this->waiters.load(std::memory_order_relaxed) == 0)
+            return;
+        std::lock_guard<std::mutex> lock(this->wait_lock);
+        this->changed.notify_all();
+    }
+
+    const size_t capacity;
+    const QueueFullPolicy policy;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<bool> closed;
+    std::atomic<int> waiters;
+    std::atomic<uint64_t> dropped;
+    std::mutex wait_lock;
+    std::condition_variable changed;
+
+    BoundedQueue(const BoundedQueue&);
+    BoundedQueue& operator=(const BoundedQueue&);
+};
+
+#endif //BOUNDED_QUEUE_H
@@ -0,0 +1,173 @@
+#include "box_flow.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+
+// a box smaller than this in the flow image has too little texture to pick corners in
+#define MIN_FLOW_BOX 8
+
+static float median(std::vector<float>& values)
+{
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+BoxFlow::BoxFlow(const FlowConfig& config)
+    : config(config), scale(1.f)
+{
+}
+
+bool BoxFlow::prepare(const cv::Mat& frame, int frame_width)
+{
+    // a corrupt MJPG buffer decodes to nothing
+    if (frame.empty() || frame_width <= 0)
+        return false;
+    int width = std::min(this->config.width, frame.cols);
+    int height = std::max(1, frame.rows * width / frame.cols);
+    if (width != frame.cols)
+        cv::resize(frame, this->small, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    else
+        this->small = frame;
+    if (this->small.channels() == 3)
+        cv::cvtColor(this->small, this->gray, cv::COLOR_BGR2GRAY);
+    else if (this->small.channels() == 2)
+        cv::extractChannel(this->small, this->gray, 0); // YUYV, the luma is channel 0
+    else
+        this->gray = this->small;
+    this->scale = (float)width / (float)frame_width;
+    const cv::Size window(this->config.window, this->config.window);
+    cv::buildOpticalFlowPyramid(this->gray, this->current, window, this->config.levels);
+    return true;
+}
+
+void BoxFlow::reset(const cv::Mat& frame, int frame_width, const std::vector<BoxInfo>& boxes)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->tracks.clear();
+    if (!this->prepare(frame, frame_width))
+    {
+        // nothing to follow from, the next propagate asks for a detection
+        this->previous.clear();
+        return;
+    }
+    const cv::Rect image(0, 0, this->gray.cols, this->gray.rows);
+
+    for (size_t b = 0; b < boxes.size(); b++)
+    {
+        Track track;
+        track.detected = boxes[b];
+        track.box = boxes[b];
+        cv::Rect area = cv::Rect(cv::Point((int)(boxes[b].x1 * this->scale), (int)(boxes[b].y1 * this->scale)),
+                                 cv::Point((int)ceil(boxes[b].x2 * this->scale), (int)ceil(boxes[b].y2 * this->scale))) & image;
+        if (area.width >= MIN_FLOW_BOX && area.height >= MIN_FLOW_BOX)
+        {
+            const int min_distance = std::max(2, std::min(area.width, area.height) / 8);
+            cv::goodFeaturesToTrack(this->gray(area), track.corners, this->config.max_corners, 0.01, min_distance);
+            for (size_t c = 0; c < track.corners.size(); c++)
+                track.corners[c] += cv::Point2f((float)area.x, (float)area.y);
+        }
+        track.picked = track.corners.size();
+        this->tracks.push_back(track);
+    }
+    std::swap(this->previous, this->current);
+}
+
+bool BoxFlow::propagate(const cv::Mat& frame, int frame_width, std::vector<BoxInfo>& boxes)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    const float previous_scale = this->scale;
+    if (!this->prepare(frame, frame_width))
+        return false;
+    // a change of resolution leaves nothing to follow
+    bool follows = !this->previous.empty() && this->previous[0].size() == this->current[0].size() && previous_scale == this->scale;
+
+    // the corners of all the boxes in one call
+    std::vector<cv::Point2f> from;
+    for (size_t t = 0; t < this->tracks.size(); t++)
+        from.insert(from.end(), this->tracks[t].corners.begin(), this->tracks[t].corners.end());
+    std::vector<cv::Point2f> to;
+    std::vector<uchar> status;
+    std::vector<float> error;
+    const bool flowed = follows && !from.empty();
+    if (flowed)
+    {
+        const cv::Size window(this->config.window, this->config.window);
+        cv::calcOpticalFlowPyrLK(this->previous, this->current, from, to, status, error, window, this->config.levels);
+    }
+
+    boxes.clear();
+    size_t first = 0;
+    for (size_t t = 0; t < this->tracks.size(); t++)
+    {
+        Track& track = this->tracks[t];
+        std::vector<cv::Point2f> before;
+        std::vector<cv::Point2f> after;
+        for (size_t c = 0; c < track.corners.size() && flowed; c++)
+        {
+            if (status[first + c])
+            {
+                before.push_back(from[first + c]);
+                after.push_back(to[first + c]);
+            }
+        }
+        first += track.corners.size();
+        track.corners = after;
+        // a box without corners (too small, or no texture) stays where it was detected
+        if (track.picked == 0)
+        {
+            boxes.push_back(track.box);
+            continue;
+        }
+        if (after.size() < std::max<size_t>(1, (size_t)ceil(this->config.min_tracked * track.picked)))
+        {
+            follows = false;
+            boxes.push_back(track.box);
+            continue;
+        }
+
+        std::vector<float> dx;
+        std::vector<float> dy;
+        for (size_t c = 0; c < after.size(); c++)
+        {
+            dx.push_back(after[c].x - before[c].x);
+            dy.push_back(after[c].y - before[c].y);
+        }
+        // the spread of the corners changes with the size of the door on the image
+        std::vector<float> ratios;
+        for (size_t i = 0; i < after.size(); i++)
+        {
+            for (size_t j = i + 1; j < after.size(); j++)
+            {
+                float d_before = (float)cv::norm(before[i] - before[j]);
+                if (d_before > 1.f)
+                    ratios.push_back((float)cv::norm(after[i] - after[j]) / d_before);
+            }
+        }
+        const float shift_x = median(dx) / this->scale;
+        const float shift_y = median(dy) / this->scale;
+        const float growth = ratios.empty() ? 1.f : median(ratios);
+
+        BoxInfo& box = track.box;
+        const float cx = (box.x1 + box.x2) / 2 + shift_x;
+        const float cy = (box.y1 + box.y2) / 2 + shift_y;
+        const float half_w = (box.x2 - box.x1) / 2 * growth;
+        const float half_h = (box.y2 - box.y1) / 2 * growth;
+        box.x1 = cx - half_w;
+        box.y1 = cy - half_h;
+        box.x2 = cx + half_w;
+        box.y2 = cy + half_h;
+        boxes.push_back(box);
+
+        // compared with the detection, so small steps cannot add up unnoticed
+        const BoxInfo& detected = track.detected;
+        const float detected_w = std::max(detected.x2 - detected.x1, 1.f);
+        const float detected_h = std::max(detected.y2 - detected.y1, 1.f);
+        const float moved_x = std::fabs(cx - (detected.x1 + detected.x2) / 2) / detected_w;
+        const float moved_y = std::fabs(cy - (detected.y1 + detected.y2) / 2) / detected_h;
+        const float size_change = std::fabs(half_w * 2 / detected_w - 1.f);
+        if (moved_x > this->config.max_shift || moved_y > this->config.max_shift || size_change > this->config.max_scale)
+            follows = false;
+    }
+    std::swap(this->previous, this->current);
+    return follows;
+}
@@ -0,0 +1,65 @@
+#ifndef BOX_FLOW_H
+#define BOX_FLOW_H
+
+#include <opencv2/core/core.hpp>
+#include <mutex>
+#include <vector>
+#include "nanodet.h"
+
+struct FlowConfig
+{
+    bool enabled = false; // false to leave the skipped frames to the tracker, or to the last results
+    int width = 640; // width of the grayscale image the flow runs on
+    int max_corners = 16; // corners followed inside each box
+    int window = 15; // Lucas-Kanade window, in pixels of the flow image
+    int levels = 2; // pyramid levels above the flow image
+    float max_shift = 0.25f; // a box moved by more than this fraction of its size since its detection brings the detection forward
+    float max_scale = 0.2f; // as does a change of its size by more than this fraction
+    float min_tracked = 0.5f; // and a box keeping fewer than this fraction of its corners
+};
+
+// carries the boxes of one camera over the frames the detector skips: on a detected frame a few
+// corners are picked inside every box, on the next frames they are followed by pyramidal
+// Lucas-Kanade flow and each box is moved by the median motion of its corners and scaled by the
+// median change of their spread. Far cheaper than an inference. When a box moves or grows too much,
+// or loses its corners, the flow can no longer be trusted and propagate asks for a detection.
+// Safe to call from several threads, the calls are serialized.
+class BoxFlow
+{
+public:
+    explicit BoxFlow(const FlowConfig& config);
+
+    // a detected frame and its boxes. frame is BGR, gray, or YUYV as 2 channels, and may be a scaled
+    // down view of the frame the boxes are in, frame_width wide
+    void reset(const cv::Mat& frame, int frame_width, const std::vector<BoxInfo>& boxes);
+
+    // a skipped frame: boxes are the boxes of the last reset moved along the flow to this frame.
+    // false when the motion is too large to follow and the frame should be detected
+    bool propagate(const cv::Mat& frame, int frame_width, std::vector<BoxInfo>& boxes);
+
+private:
+    struct Track
+    {
+        BoxInfo detected; // the box as detected
+        BoxInfo box; // the box moved to the last frame
+        std::vector<cv::Point2f> corners; // on the last frame, in flow image pixels
+        size_t picked; // corners picked on the detected frame
+    };
+
+    // the flow image of frame and its pyramid, false for an empty frame
+    bool prepare(const cv::Mat& frame, int frame_width);
+
+    FlowConfig config;
+    float scale; // flow image pixels per frame pixel
+    std::vector<Track> tracks;
+    std::vector<cv::Mat> previous;
+    std::vector<cv::Mat> current;
+    cv::Mat small;
+    cv::Mat gray;
+    std::mutex lock;
+
+    BoxFlow(const BoxFlow&);
+    BoxFlow& operator=(const BoxFlow&);
+};
+
+#endif //BOX_FLOW_H
@@ -0,0 +1,158 @@
+#include "box_tracker.h"
+#include <algorithm>
+
+// state: center x, center y, width, height and their velocities in pixels per second
+#define STATE_SIZE 8
+#define MEASURE_SIZE 4
+
+BoxTracker::BoxTracker(const TrackerConfig& config)
+    : config(config), next_id(1)
+{
+}
+
+void BoxTracker::advance(Track& track, uint64_t time_ms)
+{
+    // a frame older than the state does not move the filter back in time
+    if (time_ms <= track.time_ms)
+        return;
+    const float dt = (time_ms - track.time_ms) / 1000.f;
+    cv::KalmanFilter& filter = track.filter;
+    for (int i = 0; i < MEASURE_SIZE; i++)
+    {
+        filter.transitionMatrix.at<float>(i, i + MEASURE_SIZE) = dt;
+        // a random change of the velocity over dt: the position moves by q dt^2 / 2, the velocity by q dt
+        const float q = this->config.process_noise;
+        filter.processNoiseCov.at<float>(i, i) = q * q * dt * dt * dt * dt / 4.f;
+        filter.processNoiseCov.at<float>(i, i + MEASURE_SIZE) = q * q * dt * dt * dt / 2.f;
+        filter.processNoiseCov.at<float>(i + MEASURE_SIZE, i) = q * q * dt * dt * dt / 2.f;
+        filter.processNoiseCov.at<float>(i + MEASURE_SIZE, i + MEASURE_SIZE) = q * q * dt * dt;
+    }
+    // predict also leaves its result as the posterior state, which the correction of the update starts from
+    filter.predict();
+    track.time_ms = time_ms;
+}
+
+BoxInfo BoxTracker::state_box(const Track& track, const cv::Mat& state) const
+{
+    const float cx = state.at<float>(0);
+    const float cy = state.at<float>(1);
+    const float w = (std::max)(state.at<float>(2), 1.f);
+    const float h = (std::max)(state.at<float>(3), 1.f);
+    BoxInfo box = track.box;
+    box.x1 = cx - w / 2;
+    box.y1 = cy - h / 2;
+    box.x2 = cx + w / 2;
+    box.y2 = cy + h / 2;
+    box.track_id = track.id;
+    return box;
+}
+
+std::vector<BoxInfo> BoxTracker::update(const std::vector<BoxInfo>& detections, uint64_t timeStamp_ms)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    // tracks missed for too long are gone
+    for (size_t t = 0; t < this->tracks.size();)
+    {
+        if (timeStamp_ms > this->tracks[t]->updated_ms + (uint64_t)this->config.max_age_ms)
+            this->tracks.erase(this->tracks.begin() + t);
+        else
+            t++;
+    }
+
+    std::vector<BoxInfo> predicted(this->tracks.size());
+    for (size_t t = 0; t < this->tracks.size(); t++)
+    {
+        this->advance(*this->tracks[t], timeStamp_ms);
+        predicted[t] = this->state_box(*this->tracks[t], this->tracks[t]->filter.statePost);
+    }
+
+    // greedy association, the pairs with the largest IoU first. The label is not compared: the same
+    // door flips between closed and open
+    struct Pair
+    {
+        float iou;
+        int track;
+        int detection;
+    };
+    std::vector<Pair> pairs;
+    for (size_t t = 0; t < predicted.size(); t++)
+    {
+        for (size_t d = 0; d < detections.size(); d++)
+        {
+            float iou = cal_iou(predicted[t], detections[d]);
+            if (iou >= this->config.iou_threshold)
+                pairs.push_back(Pair{iou, (int)t, (int)d});
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const Pair& lhs, const Pair& rhs) {
+        return lhs.iou > rhs.iou;
+    });
+
+    std::vector<int> track_of(detections.size(), -1);
+    std::vector<char> matched(this->tracks.size(), 0);
+    for (size_t p = 0; p < pairs.size(); p++)
+    {
+        if (matched[pairs[p].track] || track_of[pairs[p].detection] >= 0)
+            continue;
+        matched[pairs[p].track] = 1;
+        track_of[pairs[p].detection] = pairs[p].track;
+    }
+    for (size_t t = 0; t < this->tracks.size(); t++)
+        this->tracks[t]->visible = false;
+
+    std::vector<BoxInfo> results;
+    for (size_t d = 0; d < detections.size(); d++)
+    {
+        const BoxInfo& det = detections[d];
+        cv::Mat measurement = (cv::Mat_<float>(MEASURE_SIZE, 1) << (det.x1 + det.x2) / 2, (det.y1 + det.y2) / 2,
+                               det.x2 - det.x1, det.y2 - det.y1);
+        Track* track;
+        if (track_of[d] >= 0)
+        {
+            track = this->tracks[track_of[d]].get();
+            track->filter.correct(measurement);
+        } else
+        {
+            std::unique_ptr<Track> created(new Track());
+            track = created.get();
+            track->filter.init(STATE_SIZE, MEASURE_SIZE, 0, CV_32F);
+            cv::setIdentity(track->filter.transitionMatrix);
+            cv::setIdentity(track->filter.measurementMatrix);
+            cv::setIdentity(track->filter.measurementNoiseCov, cv::Scalar::all(this->config.measurement_noise * this->config.measurement_noise));
+            // the position is known from the first detection, the velocity is not
+            cv::setIdentity(track->filter.errorCovPost, cv::Scalar::all(this->config.measurement_noise * this->config.measurement_noise));
+            for (int i = MEASURE_SIZE; i < STATE_SIZE; i++)
+                track->filter.errorCovPost.at<float>(i, i) = 1e4f;
+            track->filter.statePost = cv::Mat::zeros(STATE_SIZE, 1, CV_32F);
+            measurement.copyTo(track->filter.statePost.rowRange(0, MEASURE_SIZE));
+            track->id = this->next_id++;
+            track->time_ms = timeStamp_ms;
+            this->tracks.push_back(std::move(created));
+        }
+        track->box = det;
+        track->updated_ms = timeStamp_ms;
+        track->visible = true;
+        results.push_back(this->state_box(*track, track->filter.statePost));
+    }
+    return results;
+}
+
+std::vector<BoxInfo> BoxTracker::predict(uint64_t timeStamp_ms)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::vector<BoxInfo> results;
+    for (size_t t = 0; t < this->tracks.size(); t++)
+    {
+        Track& track = *this->tracks[t];
+        if (!track.visible)
+            continue;
+        // a copy of the state moved by its velocities, the filter stays at its last correction
+        cv::Mat state = track.filter.statePost.clone();
+        const float dt = timeStamp_ms > track.time_ms ? (timeStamp_ms - track.time_ms) / 1000.f : 0.f;
+        for (int i = 0; i < MEASURE_SIZE; i++)
+            state.at<float>(i) += state.at<float>(i + MEASURE_SIZE) * dt;
+        results.push_back(this->state_box(track, state));
+    }
+    return results;
+}
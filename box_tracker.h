@@ -0,0 +1,67 @@
+#ifndef BOX_TRACKER_H
+#define BOX_TRACKER_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/video/tracking.hpp>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+#include "nanodet.h"
+
+struct TrackerConfig
+{
+    bool enabled = false; // false to carry the last results over to the skipped frames as they are
+    float iou_threshold = 0.3f; // least IoU between a predicted track and a detection to be the same door
+    int max_age_ms = 1500; // a track missed by the detections this long is dropped
+    float process_noise = 50.f; // how fast the velocity of a box may change, in pixels per second
+    float measurement_noise = 4.f; // the jitter of the detected box edges, in pixels
+};
+
+// follows the doors of one camera from detection to detection: every track is a constant-velocity
+// Kalman filter over the box center and size, associated with the detections by IoU, and keeps its
+// id for as long as it is detected again within max_age_ms. On the frames the detector skips the
+// boxes are predicted to the capture time of the frame, so they move with the doors instead of
+// lagging at their last detected place. The time step is the capture time difference, the frames do
+// not need to be evenly spaced, but must come in capture order. Safe to call from several threads,
+// the calls are serialized.
+class BoxTracker
+{
+public:
+    explicit BoxTracker(const TrackerConfig& config);
+
+    // a frame went through the detector: the tracks are predicted to timeStamp_ms and corrected by the
+    // detections they match, the others start new tracks. Returns the boxes of the tracks detected on
+    // this frame, label and score from their detection and track_id set
+    std::vector<BoxInfo> update(const std::vector<BoxInfo>& detections, uint64_t timeStamp_ms);
+
+    // a frame the detector skipped: the boxes of the tracks detected on the last update, predicted to
+    // timeStamp_ms. The filters are left as they are, the next update advances from its last correction
+    std::vector<BoxInfo> predict(uint64_t timeStamp_ms);
+
+private:
+    struct Track
+    {
+        cv::KalmanFilter filter;
+        BoxInfo box; // the last detection, for the label and score
+        int id;
+        uint64_t time_ms; // the time the filter state is at
+        uint64_t updated_ms; // the last time a detection matched
+        bool visible; // matched on the last update
+    };
+
+    // advances the filter of the track to time_ms
+    void advance(Track& track, uint64_t time_ms);
+    // the box of the track for a filter state, statePost or a projection of it
+    BoxInfo state_box(const Track& track, const cv::Mat& state) const;
+
+    TrackerConfig config;
+    std::vector<std::unique_ptr<Track> > tracks;
+    int next_id;
+    std::mutex lock;
+
+    BoxTracker(const BoxTracker&);
+    BoxTracker& operator=(const BoxTracker&);
+};
+
+#endif //BOX_TRACKER_H
@@ -0,0 +1,188 @@
+#include "camera_scheduler.h"
+#include <algorithm>
+#include <chrono>
+
+static uint64_t now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CameraScheduler::CameraScheduler(const std::vector<int>& deadlines_ms, const QueueConfig& queue)
+    : queue(queue), cameras(deadlines_ms.size()), last_picked(-1), stopped(false)
+{
+    for (size_t i = 0; i < this->cameras.size(); i++)
+    {
+        Camera& camera = this->cameras[i];
+        camera.queued = 0;
+        camera.held = 0;
+        camera.deadline_ms = deadlines_ms[i];
+        // every camera is due right away, the round-robin decides who goes first
+        camera.due_ms = 0;
+        camera.closed = false;
+        camera.busy = false;
+        camera.misses = 0;
+        camera.dropped = 0;
+    }
+}
+
+void CameraScheduler::drop_first(Camera& camera, bool computed)
+{
+    for (std::deque<FramePacket>::iterator it = camera.frames.begin(); it != camera.frames.end(); ++it)
+    {
+        if (it->computed != computed)
+            continue;
+        camera.frames.erase(it);
+        if (computed)
+            camera.queued--;
+        else
+            camera.held--;
+        camera.dropped++;
+        return;
+    }
+}
+
+bool CameraScheduler::submit(int camera_slot, FramePacket& packet)
+{
+    packet.camera_slot = camera_slot;
+    std::unique_lock<std::mutex> guard(this->lock);
+    Camera& camera = this->cameras[camera_slot];
+    if (!packet.computed && !camera.busy && camera.frames.empty())
+        return false;
+    if (this->stopped)
+        return true;
+
+    const int capacity = std::max(this->queue.capacity, 1);
+    if (packet.computed && camera.queued >= capacity)
+    {
+        if (this->queue.policy == QUEUE_DROP_NEWEST)
+        {
+            camera.dropped++;
+            return true;
+        }
+        if (this->queue.policy == QUEUE_BLOCK)
+        {
+            while (!this->stopped && camera.queued >= capacity)
+                this->space.wait(guard);
+            if (this->stopped)
+                return true;
+        } else
+        {
+            // the skipped frames behind the dropped one stay, published with the results before it
+            this->drop_first(camera, true);
+        }
+    }
+    if (!packet.computed && camera.held >= MAX_HELD_FRAMES)
+        this->drop_first(camera, false);
+
+    if (packet.computed)
+        camera.queued++;
+    else
+        camera.held++;
+    camera.frames.push_back(std::move(packet));
+    packet = FramePacket();
+    this->ready.notify_one();
+    return true;
+}
+
+void CameraScheduler::close_camera(int camera_slot)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->cameras[camera_slot].closed = true;
+    this->ready.notify_all();
+}
+
+void CameraScheduler::close()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->stopped = true;
+    this->ready.notify_all();
+    this->space.notify_all();
+}
+
+int CameraScheduler::pick_camera() const
+{
+    const int num_cameras = (int)this->cameras.size();
+    int best = -1;
+    // walking from the camera after the last pick makes the first of equally due cameras the next in turn
+    for (int k = 1; k <= num_cameras; k++)
+    {
+        int i = (this->last_picked + k) % num_cameras;
+        const Camera& camera = this->cameras[i];
+        if (camera.busy || camera.frames.empty())
+            continue;
+        if (!camera.frames.front().computed)
+            return i;
+        if (best < 0 || camera.due_ms < this->cameras[best].due_ms)
+            best = i;
+    }
+    return best;
+}
+
+bool CameraScheduler::next(FramePacket& packet)
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (!this->stopped)
+    {
+        int i = this->pick_camera();
+        if (i >= 0)
+        {
+            Camera& camera = this->cameras[i];
+            packet = std::move(camera.frames.front());
+            camera.frames.pop_front();
+            camera.busy = true;
+            if (!packet.computed)
+            {
+                camera.held--;
+                return true;
+            }
+            camera.queued--;
+            this->space.notify_all();
+            uint64_t now = now_ms();
+            if (camera.due_ms > 0 && now > camera.due_ms)
+                camera.misses++;
+            camera.due_ms = now + camera.deadline_ms;
+            this->last_picked = i;
+            return true;
+        }
+
+        // the frames left behind a busy camera are for the worker done with it, or one waiting here
+        bool drained = true;
+        for (size_t c = 0; c < this->cameras.size(); c++)
+            drained = drained && this->cameras[c].closed && (this->cameras[c].busy || this->cameras[c].frames.empty());
+        if (drained)
+            return false;
+        this->ready.wait(guard);
+    }
+    return false;
+}
+
+void CameraScheduler::done(int camera_slot)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->cameras[camera_slot].busy = false;
+    this->ready.notify_all();
+}
+
+void CameraScheduler::set_latest_results(int camera_slot, const std::vector<BoxInfo>& results)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->cameras[camera_slot].latest = results;
+}
+
+std::vector<BoxInfo> CameraScheduler::latest_results(int camera_slot)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->cameras[camera_slot].latest;
+}
+
+uint64_t CameraScheduler::deadline_misses(int camera_slot)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->cameras[camera_slot].misses;
+}
+
+uint64_t CameraScheduler::dropped_frames(int camera_slot)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->cameras[camera_slot].dropped;
+}
@@ -0,0 +1,104 @@
+#ifndef CAMERA_SCHEDULER_H
+#define CAMERA_SCHEDULER_H
+
+#include <opencv2/core/core.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+#include "nanodet.h"
+#include "letterbox.h"
+#include "bounded_queue.h"
+#include "v4l2_capture.h"
+
+// one frame on its way from the capture stage to the publish stage
+struct FramePacket {
+    cv::Mat image; // BGR, empty until converted when the frame came from the v4l2 backend
+    RawFrame raw; // the driver buffer of the v4l2 backend
+    int camera_idx; // the camera id published with the results
+    int camera_slot; // index of the camera in the scheduler
+    uint64_t timeStamp; // capture time
+    bool computed; // the detector ran on this frame, otherwise results are carried over
+    object_rect effect_roi;
+    std::vector<BoxInfo> results;
+
+    int width() const { return this->image.empty() ? this->raw.width : this->image.cols; }
+    int height() const { return this->image.empty() ? this->raw.height : this->image.rows; }
+};
+
+// skipped frames a camera may have waiting behind its detections, the oldest is dropped beyond
+#define MAX_HELD_FRAMES 16
+
+// hands the frames of N cameras to a pool of inference workers. Every camera has its own bounded
+// capture queue filled by its capture thread, and a deadline: the longest it should go without a
+// detection. A worker asking for a frame gets one from the ready camera that is due first (the one
+// most overdue), ties going round-robin, so a slow or busy camera cannot starve the others.
+// A skipped frame queued behind a detection of its camera waits there and is handed to a worker like
+// the others, to be published with the results carried over from that detection. A camera has one
+// frame with a worker at a time, so all its frames are handed on in capture order.
+class CameraScheduler
+{
+public:
+    CameraScheduler(const std::vector<int>& deadlines_ms, const QueueConfig& queue);
+
+    int size() const { return (int)this->cameras.size(); }
+
+    // capture side, called by the capture thread of the camera only. packet is moved from when queued.
+    // The capture_queue capacity and policy apply to the frames to detect. False for a skipped frame with
+    // nothing of its camera ahead of it, the caller hands it on itself
+    bool submit(int camera_slot, FramePacket& packet);
+    // the camera delivers no more frames
+    void close_camera(int camera_slot);
+
+    // worker side: waits for the next frame to detect or to hand on (packet.computed false), false once
+    // every camera is closed and drained
+    bool next(FramePacket& packet);
+    // the worker is done with the frame next gave it (its results are handed on), the camera may be picked again
+    void done(int camera_slot);
+    // stops the scheduling, the workers return once they are done with their current frame
+    void close();
+
+    // the results of the last detected frame of a camera, carried over to its skipped frames
+    void set_latest_results(int camera_slot, const std::vector<BoxInfo>& results);
+    std::vector<BoxInfo> latest_results(int camera_slot);
+
+    // frames a worker took after the camera was already past its deadline
+    uint64_t deadline_misses(int camera_slot);
+    // frames dropped by the capture queue of a camera, to detect or skipped
+    uint64_t dropped_frames(int camera_slot);
+
+private:
+    struct Camera
+    {
+        std::deque<FramePacket> frames; // to detect and skipped, in capture order
+        int queued; // frames to detect in frames
+        int held; // skipped frames in frames
+        int deadline_ms;
+        uint64_t due_ms; // time the next detection of this camera is due
+        bool closed;
+        bool busy; // a worker has a frame of this camera
+        uint64_t misses;
+        uint64_t dropped;
+        std::vector<BoxInfo> latest;
+    };
+
+    // the ready camera due first, -1 if none has a frame queued or all those are busy. A skipped frame
+    // at the front of its queue goes first, it costs the worker nothing
+    int pick_camera() const;
+    // drops the first frame of camera that is to detect (computed) or skipped
+    void drop_first(Camera& camera, bool computed);
+
+    const QueueConfig queue;
+    std::mutex lock;
+    std::condition_variable ready;
+    std::condition_variable space; // a capture thread waiting for room under QUEUE_BLOCK
+    std::vector<Camera> cameras;
+    int last_picked;
+    bool stopped;
+
+    CameraScheduler(const CameraScheduler&);
+    CameraScheduler& operator=(const CameraScheduler&);
+};
+
+#endif //CAMERA_SCHEDULER_H
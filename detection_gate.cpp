@@ -0,0 +1,61 @@
+#include "detection_gate.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+
+DetectionGate::DetectionGate(int compute_every_frames, const MotionGateConfig& motion)
+    : compute_every_frames(compute_every_frames > 0 ? compute_every_frames : 1), motion(motion),
+      frameIndex(-1), last_detection_ms(0), detected_once(false), last_score(0.f)
+{
+}
+
+float DetectionGate::change_score(const cv::Mat& frame)
+{
+    int width = std::min(this->motion.width, frame.cols);
+    int height = std::max(1, frame.rows * width / frame.cols);
+    cv::resize(frame, this->small, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    if (this->small.channels() == 3)
+        cv::cvtColor(this->small, this->gray, cv::COLOR_BGR2GRAY);
+    else if (this->small.channels() == 2)
+        cv::extractChannel(this->small, this->gray, 0); // YUYV, the luma is channel 0
+    else
+        this->gray = this->small;
+    this->gray.convertTo(this->gray_f, CV_32F);
+
+    // the first frame, or a change of resolution, starts a new background
+    if (this->background.size() != this->gray_f.size())
+    {
+        this->gray_f.copyTo(this->background);
+        return 0.f;
+    }
+
+    cv::absdiff(this->gray_f, this->background, this->diff);
+    int changed = cv::countNonZero(this->diff > (double)this->motion.pixel_threshold);
+    cv::accumulateWeighted(this->gray_f, this->background, this->motion.background_rate);
+    return (float)changed / (float)(width * height);
+}
+
+bool DetectionGate::should_detect(const cv::Mat& frame, uint64_t timeStamp_ms)
+{
+    // nothing to score nor detect, e.g. a corrupt MJPG buffer
+    if (frame.empty())
+        return false;
+    if (!this->motion.enabled)
+    {
+        this->frameIndex++;
+        if (this->frameIndex > 10000)
+            this->frameIndex = 0;
+        return this->frameIndex % this->compute_every_frames == 0;
+    }
+
+    this->last_score = this->change_score(frame);
+    uint64_t idle_ms = timeStamp_ms - this->last_detection_ms;
+    bool detect = !this->detected_once
+                  || idle_ms >= (uint64_t)this->motion.max_idle_ms
+                  || (this->last_score >= this->motion.threshold && idle_ms >= (uint64_t)this->motion.min_interval_ms);
+    if (detect)
+    {
+        this->last_detection_ms = timeStamp_ms;
+        this->detected_once = true;
+    }
+    return detect;
+}
@@ -0,0 +1,50 @@
+#ifndef DETECTION_GATE_H
+#define DETECTION_GATE_H
+
+#include <opencv2/core/core.hpp>
+#include <stdint.h>
+
+struct MotionGateConfig
+{
+    bool enabled = false; // false for the fixed cadence of compute_every_frames
+    int width = 64; // width of the grayscale thumbnail the change is measured on
+    int pixel_threshold = 12; // gray level difference from the background for a pixel to count as changed
+    float threshold = 0.01f; // fraction of changed pixels which triggers a detection
+    float background_rate = 0.05f; // how fast the running background follows the scene
+    int min_interval_ms = 100; // shortest time between two detections while the motion goes on
+    int max_idle_ms = 2000; // longest time without detection in a still scene
+};
+
+// decides which frames of one camera go through the detector. Either every compute_every_frames-th
+// frame, or, with the motion gate, the frames where the thumbnail moved away from a running average
+// of the scene by more than the threshold, and at least one frame every max_idle_ms so the results
+// of a still scene are refreshed. Holds the background of its camera, one gate per camera.
+class DetectionGate
+{
+public:
+    DetectionGate(int compute_every_frames, const MotionGateConfig& motion);
+
+    // frame is BGR, gray, or YUYV as 2 channels; an empty one is never detected
+    bool should_detect(const cv::Mat& frame, uint64_t timeStamp_ms);
+
+    // the change score of the last frame given to the motion gate
+    float score() const { return this->last_score; }
+
+private:
+    float change_score(const cv::Mat& frame);
+
+    int compute_every_frames;
+    MotionGateConfig motion;
+    int frameIndex;
+    uint64_t last_detection_ms;
+    bool detected_once;
+    float last_score;
+
+    cv::Mat small;
+    cv::Mat gray;
+    cv::Mat gray_f;
+    cv::Mat background;
+    cv::Mat diff;
+};
+
+#endif //DETECTION_GATE_H
@@ -0,0 +1,139 @@
+#include "door_events.h"
+
+DoorEventEngine::DoorEventEngine(const DoorEventConfig& config, float det_threshold)
+    : config(config), min_score(det_threshold + config.confidence_margin), next_id(1),
+      last_heartbeat_ms(0), heartbeat_sent(false)
+{
+}
+
+int DoorEventEngine::match(const BoxInfo& box, const std::vector<char>& taken) const
+{
+    int best = -1;
+    float best_iou = this->config.iou_threshold;
+    for (size_t d = 0; d < this->doors.size(); d++)
+    {
+        if (taken[d])
+            continue;
+        // the tracker already knows which door it is
+        if (box.track_id > 0 && this->doors[d].box.track_id > 0)
+        {
+            if (box.track_id == this->doors[d].box.track_id)
+                return (int)d;
+            continue;
+        }
+        float iou = cal_iou(box, this->doors[d].box);
+        if (iou >= best_iou)
+        {
+            best_iou = iou;
+            best = (int)d;
+        }
+    }
+    return best;
+}
+
+bool DoorEventEngine::observe(Door& door, const BoxInfo& box)
+{
+    door.box = box;
+    door.missing = 0;
+    // a weak detection neither confirms nor breaks the status, but it is no longer consecutive agreement
+    if (box.label == door.status || box.score < this->min_score)
+    {
+        door.streak = 0;
+        return false;
+    }
+    if (box.label == door.candidate)
+    {
+        door.streak++;
+    } else
+    {
+        door.candidate = box.label;
+        door.streak = 1;
+    }
+    return door.streak >= this->config.confirm_frames;
+}
+
+bool DoorEventEngine::update(const std::vector<BoxInfo>& boxes, bool computed, uint64_t timeStamp_ms, DoorEvents& events)
+{
+    events.transitions.clear();
+    events.doors.clear();
+    events.heartbeat = false;
+
+    if (computed)
+    {
+        std::vector<char> taken(this->doors.size(), 0);
+        std::vector<Door> found;
+        for (size_t b = 0; b < boxes.size(); b++)
+        {
+            const int d = this->match(boxes[b], taken);
+            Door* door;
+            if (d >= 0)
+            {
+                taken[d] = 1;
+                door = &this->doors[d];
+            } else
+            {
+                Door created;
+                created.id = 0; // numbered once confirmed, so the rejected false detections use up no ids
+                created.status = DOOR_ABSENT;
+                created.candidate = DOOR_ABSENT;
+                created.streak = 0;
+                created.missing = 0;
+                found.push_back(created);
+                door = &found.back();
+            }
+            const int previous = door->status;
+            if (this->observe(*door, boxes[b]))
+            {
+                if (door->id == 0)
+                    door->id = this->next_id++;
+                door->status = door->candidate;
+                door->streak = 0;
+                DoorStatus transition = {door->id, door->status, previous, door->box};
+                events.transitions.push_back(transition);
+            }
+        }
+
+        for (size_t d = 0; d < this->doors.size();)
+        {
+            Door& door = this->doors[d];
+            if (!taken[d] && ++door.missing >= this->config.lost_frames)
+            {
+                if (door.status != DOOR_ABSENT)
+                {
+                    DoorStatus transition = {door.id, DOOR_ABSENT, door.status, door.box};
+                    events.transitions.push_back(transition);
+                }
+                this->doors.erase(this->doors.begin() + d);
+                taken.erase(taken.begin() + d);
+            } else
+            {
+                d++;
+            }
+        }
+        this->doors.insert(this->doors.end(), found.begin(), found.end());
+    }
+
+    events.any_door_open = false;
+    for (size_t d = 0; d < this->doors.size(); d++)
+    {
+        if (this->doors[d].status > 0)
+            events.any_door_open = true;
+    }
+
+    if (this->config.heartbeat_ms > 0
+        && (!this->heartbeat_sent || timeStamp_ms >= this->last_heartbeat_ms + (uint64_t)this->config.heartbeat_ms))
+    {
+        events.heartbeat = true;
+        this->heartbeat_sent = true;
+        this->last_heartbeat_ms = timeStamp_ms;
+        for (size_t d = 0; d < this->doors.size(); d++)
+        {
+            const Door& door = this->doors[d];
+            if (door.status == DOOR_ABSENT)
+                continue;
+            DoorStatus snapshot = {door.id, door.status, door.status, door.box};
+            events.doors.push_back(snapshot);
+        }
+    }
+    return events.heartbeat || !events.transitions.empty();
+}
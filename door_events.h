@@ -0,0 +1,76 @@
+#ifndef DOOR_EVENTS_H
+#define DOOR_EVENTS_H
+
+#include <vector>
+#include <stdint.h>
+#include "nanodet.h"
+
+// status of a door which is no longer seen, and the previous status of a door seen for the first time
+#define DOOR_ABSENT -1
+
+struct DoorEventConfig
+{
+    bool enabled = false; // false publishes the full door list of every frame
+    int confirm_frames = 3; // consecutive detected frames agreeing on a new status before the door takes it
+    float confidence_margin = 0.1f; // only detections scoring det_threshold + margin or more count towards a change
+    int lost_frames = 30; // detected frames without the door before it is reported absent
+    float iou_threshold = 0.3f; // least IoU for a box to be the same door, when the boxes have no track id
+    int heartbeat_ms = 5000; // a snapshot of all the doors at least this often, 0 for none
+};
+
+struct DoorStatus
+{
+    int door_id;
+    int status; // the debounced label, 0 for close, 1 for open, DOOR_ABSENT once lost
+    int previous; // the status before the transition, DOOR_ABSENT for a new door
+    BoxInfo box; // the last box of the door, in frame coordinates
+};
+
+struct DoorEvents
+{
+    std::vector<DoorStatus> transitions; // the doors which changed status on this frame
+    bool heartbeat = false; // doors holds every confirmed door
+    std::vector<DoorStatus> doors;
+    bool any_door_open = false; // any confirmed door is open
+};
+
+// turns the per-frame boxes of one camera into door status changes: every door keeps a debounced
+// status which only flips after confirm_frames consecutive detected frames agree on the other label
+// with a clear score, so a flickering or borderline detection never reaches the consumers. Doors are
+// followed by the track id of their boxes, or by IoU without the tracker. Between the transitions
+// only a heartbeat snapshot is published, a quiet site costs almost no IPC.
+class DoorEventEngine
+{
+public:
+    DoorEventEngine(const DoorEventConfig& config, float det_threshold);
+
+    // the boxes of one frame, computed when they come from the detector and not carried over from a
+    // previous frame (those do not count towards a change). Fills events and returns true when there
+    // is something to publish
+    bool update(const std::vector<BoxInfo>& boxes, bool computed, uint64_t timeStamp_ms, DoorEvents& events);
+
+private:
+    struct Door
+    {
+        int id;
+        int status; // DOOR_ABSENT until confirmed
+        int candidate; // the label the streak agrees on
+        int streak;
+        int missing; // detected frames without the door
+        BoxInfo box;
+    };
+
+    // the door the box belongs to, or -1
+    int match(const BoxInfo& box, const std::vector<char>& taken) const;
+    // counts the label of the box towards the status of the door, true when the door changes
+    bool observe(Door& door, const BoxInfo& box);
+
+    DoorEventConfig config;
+    float min_score;
+    std::vector<Door> doors;
+    int next_id;
+    uint64_t last_heartbeat_ms;
+    bool heartbeat_sent;
+};
+
+#endif //DOOR_EVENTS_H
@@ -0,0 +1,97 @@
+#ifndef DOOR_RESULTS_H
+#define DOOR_RESULTS_H
+
+/*
+ * The binary messages of shared_memory_format "binary", plain C for the consumers: a DoorResultRecord
+ * followed by door_count DoorResultEntry, every field 4 or 8 bytes wide at its natural alignment so
+ * the layout has no padding, little-endian. A message read from the ring (result_ring.h) is used in
+ * place, nothing is parsed:
+ *
+ *     const DoorResultRecord* record;
+ *     const DoorResultEntry* doors;
+ *     if (door_results_view(buffer, length, &record, &doors))
+ *         for (uint32_t i = 0; i < record->door_count; i++)
+ *             printf("door %d: %d\n", doors[i].door_id, doors[i].status);
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the door result records are little-endian and read in place"
+#endif
+
+#define DOOR_RESULTS_MAGIC 0x52445244u /* "DRDR" */
+#define DOOR_RESULTS_VERSION 1
+
+/* DoorResultRecord.kind */
+#define DOOR_RESULTS_FRAME 0 /* the doors detected on a frame */
+#define DOOR_RESULTS_TRANSITION 1 /* door_events: the doors which changed status */
+#define DOOR_RESULTS_HEARTBEAT 2 /* door_events: the changes, if any, then every door */
+
+/* DoorResultRecord.flags */
+#define DOOR_RESULTS_ANY_OPEN 1u
+
+/* DoorResultEntry.flags */
+#define DOOR_ENTRY_TRANSITION 1u /* a status change, previous_status is set */
+
+/* DoorResultEntry.status of a door no longer seen, and previous_status of a new door */
+#define DOOR_STATUS_ABSENT -1
+
+typedef struct DoorResultRecord
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t kind;
+    int32_t camera_idx;
+    uint32_t door_count;
+    uint64_t timestamp_ms; /* capture time of the frame, milliseconds since the epoch */
+    uint32_t flags;
+    uint32_t entry_size; /* sizeof(DoorResultEntry) of the writer, checked by door_results_view */
+} DoorResultRecord;
+
+typedef struct DoorResultEntry
+{
+    float x; /* the box in frame pixels */
+    float y;
+    float width;
+    float height;
+    float confidence;
+    int32_t status; /* 0 close, 1 open */
+    int32_t previous_status; /* with DOOR_ENTRY_TRANSITION */
+    int32_t door_id; /* door_events id, 0 otherwise */
+    int32_t track_id; /* tracker id, 0 when not tracked */
+    uint32_t flags;
+} DoorResultEntry;
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+static_assert(sizeof(DoorResultRecord) == 32, "DoorResultRecord layout");
+static_assert(sizeof(DoorResultEntry) == 40, "DoorResultEntry layout");
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+_Static_assert(sizeof(DoorResultRecord) == 32, "DoorResultRecord layout");
+_Static_assert(sizeof(DoorResultEntry) == 40, "DoorResultEntry layout");
+#endif
+
+/* the bytes of a message of door_count doors */
+static inline size_t door_results_size(uint32_t door_count)
+{
+    return sizeof(DoorResultRecord) + (size_t)door_count * sizeof(DoorResultEntry);
+}
+
+/*
+ * points record and doors into a message of length bytes, which must be 4-byte aligned (the ring
+ * slots and any malloc'ed buffer are). Returns 0 for a message which is not a complete record of
+ * this version, e.g. a JSON one.
+ */
+static inline int door_results_view(const void* message, uint32_t length, const DoorResultRecord** record, const DoorResultEntry** doors)
+{
+    const DoorResultRecord* header = (const DoorResultRecord*)message;
+    if (length < sizeof(DoorResultRecord) || header->magic != DOOR_RESULTS_MAGIC || header->version != DOOR_RESULTS_VERSION
+        || header->entry_size != sizeof(DoorResultEntry) || length < door_results_size(header->door_count))
+        return 0;
+    *record = header;
+    *doors = (const DoorResultEntry*)(header + 1);
+    return 1;
+}
+
+#endif /* DOOR_RESULTS_H */
@@ -0,0 +1,423 @@
+#ifndef FRAME_BUS_H
+#define FRAME_BUS_H
+
+/*
+ * The camera frames the detector shares with the other processes of the box (recording, a remote UI),
+ * so they need not open the cameras themselves. Plain C for the consumers, like result_ring.h.
+ *
+ * The segment is a header, slot_count slot descriptors, then slot_count page-aligned frames of
+ * frame_bytes each. A slot holds one frame, BGR24 rows of stride bytes, and its metadata: camera,
+ * capture timestamp, detection sequence number. A consumer uses the pixels where they are, e.g.
+ * cv::Mat(slot->height, slot->width, CV_8UC3, (void*)frame.pixels, slot->stride), nothing is copied
+ * nor decoded.
+ *
+ * Reference counting: a consumer pins the newest frame of a camera with frame_bus_acquire and unpins
+ * it with frame_bus_release. The writer only fills the slots nobody pins which are not the newest
+ * frame of a camera, the oldest first; with every slot pinned the frame is dropped, the writer never
+ * waits. Since the newest frame of every camera keeps its slot, a bus needs more slots than cameras,
+ * two per camera leave room for one pin each. A pin should be short (copy out what has to be kept longer): a slot pinned for longer than
+ * the hold time of the writer counts as left behind by a dead consumer and is taken back, and is then
+ * overwritten while its consumer may still read it: a consumer which copies the frame out checks the
+ * copy with frame_bus_validate afterwards. The pin count shares one word with the frame number of the
+ * slot, so a pin is only ever taken from or given back to the frame it was made on.
+ *
+ * Waking up: every frame bumps the futex word of the header, frame_bus_wait sleeps on it; the writer
+ * only makes the FUTEX_WAKE system call when a consumer sleeps. Restarts work as in result_ring.h: a
+ * writer started again on a bus of the same geometry continues it, one it cannot reuse is marked
+ * closed (frame_bus_wait returns -1) before it is replaced, to be mapped again by name.
+ *
+ * Single writer, any number of consumers in any number of processes. Linux only (futex).
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAME_BUS_MAGIC 0x53554246u /* "FBUS" */
+#define FRAME_BUS_VERSION 2
+#define FRAME_BUS_MAX_CAMERAS 16
+#define FRAME_BUS_ALIGN 4096
+
+/* FrameBusSlot.format */
+#define FRAME_BUS_BGR24 0
+
+/* FrameBusSlot.flags */
+#define FRAME_BUS_ANNOTATED 1u /* the boxes and the warning are drawn in, as on the screen */
+#define FRAME_BUS_COMPUTED 2u /* the detector ran on this frame, otherwise its boxes were carried over */
+
+/* FrameBusSlot.pins while the writer fills the slot */
+#define FRAME_BUS_WRITING 0x80000000u
+
+/* the pin count (low half, FRAME_BUS_WRITING while the writer fills the slot) and the frame number it
+ * belongs to (high half, the low 32 bits of the sequence) of FrameBusSlot.pins */
+#define FRAME_BUS_REFS(pins) ((uint32_t)(pins))
+#define FRAME_BUS_TAG(pins) ((uint32_t)((pins) >> 32))
+#define FRAME_BUS_PINS(sequence, refs) ((uint64_t)(uint32_t)(sequence) << 32 | (uint32_t)(refs))
+
+typedef struct FrameBusSlot
+{
+    uint64_t pins; /* the consumers pinning the frame and its frame number, see FRAME_BUS_REFS */
+    uint64_t sequence; /* frame number over all the cameras, 0 for an empty slot */
+    uint64_t acquired_ns; /* CLOCK_MONOTONIC time of the last pin, stored before the pin itself */
+    uint64_t publish_ns; /* CLOCK_MONOTONIC time of the publish */
+    uint64_t timestamp_ms; /* capture time of the frame, milliseconds since the epoch, as in the results */
+    uint64_t detection_sequence; /* the detections of the camera so far, the boxes are those of the last one */
+    uint32_t camera; /* the camera of the bus, index of latest */
+    int32_t camera_idx; /* the camera id published with the results */
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride; /* bytes from one row to the next */
+    uint32_t format;
+    uint32_t flags;
+    uint32_t reserved;
+} FrameBusSlot;
+
+typedef struct FrameBusHeader
+{
+    uint32_t magic; /* written last, FRAME_BUS_MAGIC once the bus is ready */
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t frame_bytes; /* the largest frame */
+    uint64_t sequence; /* frames published so far */
+    uint64_t dropped; /* frames not published because every slot was pinned */
+    uint64_t oversized; /* frames larger than frame_bytes, not published */
+    uint64_t reclaimed; /* slots taken back from consumers which held them past the hold time */
+    uint32_t futex; /* bumped by every frame, the consumers sleep on it */
+    uint32_t waiters; /* consumers sleeping on the futex */
+    uint64_t wakeups; /* FUTEX_WAKE system calls of the writer */
+    uint32_t writer_pid; /* the running writer, 0 after it stopped */
+    uint32_t closed; /* replaced by a new bus, to be opened again by name */
+    uint64_t generation; /* writer starts on this bus */
+    uint32_t cameras; /* cameras published so far, the valid entries of latest */
+    uint32_t reserved;
+    int32_t latest[FRAME_BUS_MAX_CAMERAS]; /* slot of the newest frame of each camera, -1 before its first */
+} FrameBusHeader;
+
+/* a frame pinned by frame_bus_acquire */
+typedef struct FrameBusFrame
+{
+    int index;
+    uint64_t sequence;
+    const FrameBusSlot* slot;
+    const uint8_t* pixels;
+} FrameBusFrame;
+
+#define FRAME_BUS_ROUND(size) (((size) + FRAME_BUS_ALIGN - 1) & ~(size_t)(FRAME_BUS_ALIGN - 1))
+
+static inline size_t frame_bus_pixels_offset(uint32_t slot_count)
+{
+    return FRAME_BUS_ROUND(sizeof(FrameBusHeader) + (size_t)slot_count * sizeof(FrameBusSlot));
+}
+
+/* the bytes of the segment of a bus */
+static inline size_t frame_bus_size(uint32_t slot_count, uint32_t frame_bytes)
+{
+    return frame_bus_pixels_offset(slot_count) + (size_t)slot_count * FRAME_BUS_ROUND(frame_bytes);
+}
+
+static inline FrameBusSlot* frame_bus_slot(FrameBusHeader* bus, int index)
+{
+    return (FrameBusSlot*)(bus + 1) + index;
+}
+
+static inline uint8_t* frame_bus_pixels(FrameBusHeader* bus, int index)
+{
+    return (uint8_t*)bus + frame_bus_pixels_offset(bus->slot_count) + (size_t)index * FRAME_BUS_ROUND(bus->frame_bytes);
+}
+
+static inline uint64_t frame_bus_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/* non-zero once the writer has set the bus up */
+static inline int frame_bus_ready(FrameBusHeader* bus)
+{
+    return __atomic_load_n(&bus->magic, __ATOMIC_ACQUIRE) == FRAME_BUS_MAGIC && bus->version == FRAME_BUS_VERSION;
+}
+
+/*
+ * writer: sets the bus up in a segment of frame_bus_size(slot_count, frame_bytes) bytes and registers
+ * the calling process as its writer. The bus a previous run of the writer left with the same geometry
+ * is continued, the frames still pinned stay with their consumers. Returns 1 when the bus was
+ * continued, 0 when it was set up anew.
+ */
+static inline int frame_bus_init(FrameBusHeader* bus, uint32_t slot_count, uint32_t frame_bytes)
+{
+    int continued = frame_bus_ready(bus) && !bus->closed && bus->slot_count == slot_count && bus->frame_bytes == frame_bytes;
+    if (!continued)
+    {
+        __atomic_store_n(&bus->magic, 0, __ATOMIC_RELEASE);
+        memset((char*)bus + sizeof(bus->magic), 0, frame_bus_pixels_offset(slot_count) - sizeof(bus->magic));
+        bus->version = FRAME_BUS_VERSION;
+        bus->slot_count = slot_count;
+        bus->frame_bytes = frame_bytes;
+        for (int c = 0; c < FRAME_BUS_MAX_CAMERAS; c++)
+            bus->latest[c] = -1;
+    }
+    /* a slot the previous writer died filling is emptied, it never became the newest frame of a camera */
+    for (uint32_t i = 0; i < slot_count; i++)
+    {
+        FrameBusSlot* slot = frame_bus_slot(bus, (int)i);
+        if (FRAME_BUS_REFS(__atomic_load_n(&slot->pins, __ATOMIC_ACQUIRE)) & FRAME_BUS_WRITING)
+        {
+            slot->sequence = 0;
+            __atomic_store_n(&slot->pins, 0, __ATOMIC_RELEASE);
+        }
+    }
+    bus->generation++;
+    __atomic_store_n(&bus->writer_pid, (uint32_t)getpid(), __ATOMIC_RELEASE);
+    __atomic_store_n(&bus->magic, FRAME_BUS_MAGIC, __ATOMIC_RELEASE);
+    return continued;
+}
+
+/* writer: wakes every sleeping consumer, without a system call when none sleeps */
+static inline void frame_bus_notify(FrameBusHeader* bus)
+{
+    /* sequentially consistent with the waiters increment of frame_bus_wait, see result_ring_notify */
+    __atomic_fetch_add(&bus->futex, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&bus->waiters, __ATOMIC_SEQ_CST) == 0)
+        return;
+    syscall(SYS_futex, &bus->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    __atomic_fetch_add(&bus->wakeups, 1, __ATOMIC_RELAXED);
+}
+
+/* writer: the writer stops, with closed the bus is about to be replaced (see result_ring_stop) */
+static inline void frame_bus_stop(FrameBusHeader* bus, int closed)
+{
+    __atomic_store_n(&bus->writer_pid, 0, __ATOMIC_RELEASE);
+    if (closed)
+        __atomic_store_n(&bus->closed, 1, __ATOMIC_RELEASE);
+    frame_bus_notify(bus);
+}
+
+static inline int frame_bus_is_latest(FrameBusHeader* bus, int index)
+{
+    for (uint32_t c = 0; c < bus->cameras; c++)
+    {
+        if (bus->latest[c] == index)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * writer: takes a slot for the next frame of camera, the unpinned one with the oldest frame, else one
+ * pinned for longer than hold_ns. Returns its index, or -1 when the frame has to be dropped. The
+ * writer then fills the pixels and the metadata of the slot and calls frame_bus_commit, or
+ * frame_bus_abort to give it back unpublished.
+ */
+static inline int frame_bus_begin(FrameBusHeader* bus, uint32_t camera, uint64_t hold_ns)
+{
+    if (camera >= FRAME_BUS_MAX_CAMERAS)
+        return -1;
+    const uint64_t now = frame_bus_now_ns();
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        int best = -1;
+        uint64_t best_pins = 0;
+        int best_stale = 1;
+        uint64_t best_sequence = 0;
+        for (uint32_t i = 0; i < bus->slot_count; i++)
+        {
+            FrameBusSlot* slot = frame_bus_slot(bus, (int)i);
+            if (frame_bus_is_latest(bus, (int)i))
+                continue;
+            const uint64_t pins = __atomic_load_n(&slot->pins, __ATOMIC_ACQUIRE);
+            const int stale = FRAME_BUS_REFS(pins) != 0;
+            const uint64_t acquired = __atomic_load_n(&slot->acquired_ns, __ATOMIC_RELAXED);
+            if (stale && (acquired >= now || now - acquired < hold_ns))
+                continue;
+            /* a free slot before a stale one, the oldest frame first */
+            if (best < 0 || stale < best_stale || (stale == best_stale && slot->sequence < best_sequence))
+            {
+                best = (int)i;
+                best_pins = pins;
+                best_stale = stale;
+                best_sequence = slot->sequence;
+            }
+        }
+        if (best < 0)
+            break;
+        if (__atomic_compare_exchange_n(&frame_bus_slot(bus, best)->pins, &best_pins, FRAME_BUS_PINS(0, FRAME_BUS_WRITING), 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            /* the new pixels are ordered after the pin word, for frame_bus_validate */
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            if (best_stale)
+                __atomic_fetch_add(&bus->reclaimed, 1, __ATOMIC_RELAXED);
+            frame_bus_slot(bus, best)->camera = camera;
+            return best;
+        }
+    }
+    __atomic_fetch_add(&bus->dropped, 1, __ATOMIC_RELAXED);
+    return -1;
+}
+
+/* writer: publishes the frame filled into the slot of frame_bus_begin as the newest of its camera */
+static inline void frame_bus_commit(FrameBusHeader* bus, int index)
+{
+    FrameBusSlot* slot = frame_bus_slot(bus, index);
+    slot->publish_ns = frame_bus_now_ns();
+    slot->sequence = __atomic_load_n(&bus->sequence, __ATOMIC_RELAXED) + 1;
+    __atomic_store_n(&slot->pins, FRAME_BUS_PINS(slot->sequence, 0), __ATOMIC_RELEASE);
+    if (slot->camera >= bus->cameras)
+        __atomic_store_n(&bus->cameras, slot->camera + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&bus->latest[slot->camera], index, __ATOMIC_RELEASE);
+    __atomic_store_n(&bus->sequence, slot->sequence, __ATOMIC_RELEASE);
+    frame_bus_notify(bus);
+}
+
+static inline void frame_bus_abort(FrameBusHeader* bus, int index)
+{
+    FrameBusSlot* slot = frame_bus_slot(bus, index);
+    slot->sequence = 0;
+    __atomic_store_n(&slot->pins, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * consumer: maps the bus the writer created with shm_open(name), NULL while there is none (yet) or
+ * only the closed one about to be replaced. size receives the bytes to give to frame_bus_unmap.
+ */
+static inline FrameBusHeader* frame_bus_map(const char* name, size_t* size)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1)
+        return NULL;
+    struct stat info;
+    void* memory = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(FrameBusHeader))
+        memory = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        return NULL;
+    FrameBusHeader* bus = (FrameBusHeader*)memory;
+    if (!frame_bus_ready(bus) || __atomic_load_n(&bus->closed, __ATOMIC_ACQUIRE)
+        || frame_bus_size(bus->slot_count, bus->frame_bytes) > (size_t)info.st_size)
+    {
+        munmap(memory, (size_t)info.st_size);
+        return NULL;
+    }
+    *size = (size_t)info.st_size;
+    return bus;
+}
+
+static inline void frame_bus_unmap(FrameBusHeader* bus, size_t size)
+{
+    munmap(bus, size);
+}
+
+/*
+ * consumer: sleeps until a frame newer than sequence (a frame number, 0 for any) is published, up to
+ * timeout_ms (-1 for no limit). Returns 1 when there is one, 0 on the timeout, -1 when the bus was
+ * closed and has to be mapped again.
+ */
+static inline int frame_bus_wait(FrameBusHeader* bus, uint64_t sequence, int timeout_ms)
+{
+    const uint64_t deadline = timeout_ms >= 0 ? frame_bus_now_ns() + (uint64_t)timeout_ms * 1000000ull : 0;
+    for (;;)
+    {
+        const uint32_t seen = __atomic_load_n(&bus->futex, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&bus->sequence, __ATOMIC_ACQUIRE) > sequence)
+            return 1;
+        if (__atomic_load_n(&bus->closed, __ATOMIC_ACQUIRE))
+            return -1;
+
+        struct timespec timeout;
+        if (timeout_ms >= 0)
+        {
+            const uint64_t now = frame_bus_now_ns();
+            if (now >= deadline)
+                return 0;
+            timeout.tv_sec = (time_t)((deadline - now) / 1000000000ull);
+            timeout.tv_nsec = (long)((deadline - now) % 1000000000ull);
+        }
+        __atomic_fetch_add(&bus->waiters, 1, __ATOMIC_SEQ_CST);
+        syscall(SYS_futex, &bus->futex, FUTEX_WAIT, seen, timeout_ms >= 0 ? &timeout : NULL, NULL, 0);
+        __atomic_fetch_sub(&bus->waiters, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/*
+ * consumer: unpins a frame of frame_bus_acquire. A frame the writer already took back is left alone:
+ * the pin count only goes down while the slot still holds the frame it was taken on.
+ */
+static inline void frame_bus_release(FrameBusHeader* bus, const FrameBusFrame* frame)
+{
+    FrameBusSlot* slot = frame_bus_slot(bus, frame->index);
+    uint64_t pins = __atomic_load_n(&slot->pins, __ATOMIC_ACQUIRE);
+    do
+    {
+        if (FRAME_BUS_TAG(pins) != (uint32_t)frame->sequence || FRAME_BUS_REFS(pins) == 0
+            || (FRAME_BUS_REFS(pins) & FRAME_BUS_WRITING))
+            return;
+    } while (!__atomic_compare_exchange_n(&slot->pins, &pins, pins - 1, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * consumer: non-zero when the pixels and metadata read from frame so far are those of its frame, 0 when
+ * the writer took the slot back as stale meanwhile and what was read may be torn. To call after copying
+ * the frame out, or after any use of the pixels which must not be of another frame; a frame found
+ * invalid is still released as usual.
+ */
+static inline int frame_bus_validate(FrameBusHeader* bus, const FrameBusFrame* frame)
+{
+    const FrameBusSlot* slot = frame_bus_slot(bus, frame->index);
+    /* the reads of the pixels before the pin word, paired with the fence of frame_bus_begin */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    const uint64_t pins = __atomic_load_n(&slot->pins, __ATOMIC_RELAXED);
+    return FRAME_BUS_TAG(pins) == (uint32_t)frame->sequence && !(FRAME_BUS_REFS(pins) & FRAME_BUS_WRITING);
+}
+
+/*
+ * consumer: pins the newest frame of camera (0 .. cameras - 1) into frame, which stays valid until
+ * frame_bus_release. Returns 0 when the camera has no frame yet.
+ */
+static inline int frame_bus_acquire(FrameBusHeader* bus, uint32_t camera, FrameBusFrame* frame)
+{
+    if (camera >= FRAME_BUS_MAX_CAMERAS)
+        return 0;
+    for (int attempt = 0; attempt < 16; attempt++)
+    {
+        const int index = __atomic_load_n(&bus->latest[camera], __ATOMIC_ACQUIRE);
+        if (index < 0 || (uint32_t)index >= bus->slot_count)
+            return 0;
+        FrameBusSlot* slot = frame_bus_slot(bus, index);
+        /* the time goes first: a writer seeing the pin sees it is no stale one */
+        __atomic_store_n(&slot->acquired_ns, frame_bus_now_ns(), __ATOMIC_RELAXED);
+        uint64_t pins = __atomic_load_n(&slot->pins, __ATOMIC_RELAXED);
+        int pinned = 0;
+        while (!(FRAME_BUS_REFS(pins) & FRAME_BUS_WRITING) && FRAME_BUS_TAG(pins) != 0 && !pinned)
+            pinned = __atomic_compare_exchange_n(&slot->pins, &pins, pins + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+        if (!pinned)
+            continue;
+        /* the writer cannot reuse the slot any more unless the pin goes stale, but may have done so
+           between latest and the pin */
+        frame->index = index;
+        frame->sequence = FRAME_BUS_TAG(pins);
+        const uint64_t sequence = slot->sequence;
+        if (slot->camera != camera || FRAME_BUS_TAG(pins) != (uint32_t)sequence)
+        {
+            frame_bus_release(bus, frame);
+            continue;
+        }
+        frame->sequence = sequence;
+        frame->slot = slot;
+        frame->pixels = frame_bus_pixels(bus, index);
+        return 1;
+    }
+    return 0;
+}
+
+#endif /* FRAME_BUS_H */
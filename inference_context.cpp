@@ -0,0 +1,37 @@
+#include "inference_context.h"
+
+InferenceContext::InferenceContext()
+{
+    // any large enough recycled buffer is taken, and the pools never hand memory back to the
+    // system on their own: the intermediate blobs of the graph outnumber the default budget of 10
+    this->blob_pool_allocator.set_size_compare_ratio(0.f);
+    this->blob_pool_allocator.set_size_drop_threshold(1024);
+    this->workspace_pool_allocator.set_size_compare_ratio(0.f);
+    this->workspace_pool_allocator.set_size_drop_threshold(1024);
+}
+
+InferenceContext::~InferenceContext()
+{
+    // the input goes back to the pool before the pool itself is destroyed
+    this->input.release();
+    this->blob_pool_allocator.clear();
+    this->workspace_pool_allocator.clear();
+}
+
+ncnn::Extractor InferenceContext::create_extractor(const ncnn::Net* net)
+{
+    ncnn::Extractor ex = net->create_extractor();
+    ex.set_blob_allocator(&this->blob_pool_allocator);
+    ex.set_workspace_allocator(&this->workspace_pool_allocator);
+    return ex;
+}
+
+AllocationStats InferenceContext::blob_stats()
+{
+    return this->blob_pool_allocator.get_stats();
+}
+
+AllocationStats InferenceContext::workspace_stats()
+{
+    return this->workspace_pool_allocator.get_stats();
+}
@@ -0,0 +1,82 @@
+#ifndef INFERENCE_CONTEXT_H
+#define INFERENCE_CONTEXT_H
+
+#include <net.h>
+#include <allocator.h>
+#include <atomic>
+#include <stdint.h>
+
+struct AllocationStats
+{
+    uint64_t requests; // fastMalloc calls served by the pool
+    uint64_t new_buffers; // requests the pool could not serve from a recycled buffer
+};
+
+// pool allocator which counts its requests and the buffers it had to take from the system. The
+// pool keeps every buffer handed back, so it has to take a new one whenever more buffers are out at
+// once than ever before: new_buffers is the high-water mark of the buffers out. In the steady state it
+// stops growing while requests keeps increasing frame after frame. A request larger than every free
+// buffer of the pool also takes a new one without being counted, the sizes settle after the first
+// frames. Relaxed atomics only, the workspace pool is shared by the openmp workers of a layer.
+template<typename PoolT>
+class CountingPoolAllocator : public PoolT
+{
+public:
+    CountingPoolAllocator() : requests(0), outstanding(0), high_water(0) {}
+
+    virtual void* fastMalloc(size_t size)
+    {
+        void* ptr = PoolT::fastMalloc(size);
+        this->requests.fetch_add(1, std::memory_order_relaxed);
+        uint64_t out = this->outstanding.fetch_add(1, std::memory_order_relaxed) + 1;
+        uint64_t most = this->high_water.load(std::memory_order_relaxed);
+        while (out > most && !this->high_water.compare_exchange_weak(most, out, std::memory_order_relaxed))
+            ;
+        return ptr;
+    }
+
+    virtual void fastFree(void* ptr)
+    {
+        this->outstanding.fetch_sub(1, std::memory_order_relaxed);
+        PoolT::fastFree(ptr);
+    }
+
+    AllocationStats get_stats() const
+    {
+        AllocationStats stats = {this->requests.load(std::memory_order_relaxed), this->high_water.load(std::memory_order_relaxed)};
+        return stats;
+    }
+
+private:
+    std::atomic<uint64_t> requests;
+    std::atomic<uint64_t> outstanding; // buffers handed out and not given back
+    std::atomic<uint64_t> high_water; // the most buffers out at once
+};
+
+// everything one inference needs besides the network itself, kept across frames: the blob and
+// workspace pools the extractor allocates from and the input mat. The blob pool is only touched by
+// the thread running the extractor, the workspace pool is shared by the openmp workers of a layer.
+class InferenceContext
+{
+public:
+    InferenceContext();
+    ~InferenceContext();
+
+    // an extractor of net allocating from this context's pools
+    ncnn::Extractor create_extractor(const ncnn::Net* net);
+
+    AllocationStats blob_stats();
+    AllocationStats workspace_stats();
+
+    CountingPoolAllocator<ncnn::UnlockedPoolAllocator> blob_pool_allocator;
+    CountingPoolAllocator<ncnn::PoolAllocator> workspace_pool_allocator;
+
+    // the network input of the current frame, its buffer comes from the blob pool
+    ncnn::Mat input;
+
+private:
+    InferenceContext(const InferenceContext&);
+    InferenceContext& operator=(const InferenceContext&);
+};
+
+#endif //INFERENCE_CONTEXT_H
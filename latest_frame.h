@@ -0,0 +1,111 @@
+#ifndef LATEST_FRAME_H
+#define LATEST_FRAME_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <stdint.h>
+
+// triple buffer between a capture thread grabbing frames as fast as the camera delivers them and a
+// reader which only ever wants the newest one. The writer fills its back slot and publishes it by
+// swapping its index with the middle slot, the reader takes the middle slot by swapping it with its
+// front slot: no item is ever copied and neither side waits on the other. A frame the reader did
+// not take before the next one was published is simply overwritten (counted in overwritten_count).
+template<typename T>
+class LatestFrameBuffer
+{
+public:
+    LatestFrameBuffer()
+        : back(0), middle(1), front(2), closed(false), published(0), overwritten(0)
+    {
+    }
+
+    // the slot the writer fills next, only valid until publish()
+    T& write_slot()
+    {
+        return this->slots[this->back];
+    }
+
+    // makes the write slot the newest frame, the frame published before is dropped if not taken yet
+    void publish()
+    {
+        int previous = this->middle.exchange(this->back | FRESH, std::memory_order_acq_rel);
+        if (previous & FRESH)
+            this->overwritten.fetch_add(1, std::memory_order_relaxed);
+        this->back = previous & INDEX_MASK;
+        this->published.fetch_add(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(this->wait_lock);
+        this->changed.notify_all();
+    }
+
+    // swaps the newest frame into item, waiting for one the reader has not seen yet.
+    // item's previous content goes back to the writer. false once closed with nothing new to take
+    bool take(T& item)
+    {
+        while (!this->try_take(item))
+        {
+            std::unique_lock<std::mutex> lock(this->wait_lock);
+            if (this->middle.load(std::memory_order_acquire) & FRESH)
+                continue;
+            if (this->closed.load(std::memory_order_acquire))
+                return false;
+            this->changed.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        return true;
+    }
+
+    bool try_take(T& item)
+    {
+        if (!(this->middle.load(std::memory_order_acquire) & FRESH))
+            return false;
+        this->front = this->middle.exchange(this->front, std::memory_order_acq_rel) & INDEX_MASK;
+        std::swap(item, this->slots[this->front]);
+        return true;
+    }
+
+    // the writer is done: take returns the last published frame if not taken yet, then fails
+    void close()
+    {
+        this->closed.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(this->wait_lock);
+        this->changed.notify_all();
+    }
+
+    bool is_closed() const
+    {
+        return this->closed.load(std::memory_order_acquire);
+    }
+
+    // frames published by the writer so far
+    uint64_t published_count() const
+    {
+        return this->published.load(std::memory_order_relaxed);
+    }
+
+    // frames replaced by a newer one before the reader took them
+    uint64_t overwritten_count() const
+    {
+        return this->overwritten.load(std::memory_order_relaxed);
+    }
+
+private:
+    enum { INDEX_MASK = 3, FRESH = 4 };
+
+    T slots[3];
+    int back; // writer only
+    std::atomic<int> middle; // slot index, with FRESH while the reader has not taken it
+    int front; // reader only
+    std::atomic<bool> closed;
+    std::atomic<uint64_t> published;
+    std::atomic<uint64_t> overwritten;
+    std::mutex wait_lock;
+    std::condition_variable changed;
+
+    LatestFrameBuffer(const LatestFrameBuffer&);
+    LatestFrameBuffer& operator=(const LatestFrameBuffer&);
+};
+
+#endif //LATEST_FRAME_H
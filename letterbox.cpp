@@ -0,0 +1,398 @@
+#include "letterbox.h"
+#include <opencv2/opencv.hpp>
+#include <cstring>
+#include <vector>
+
+int resize_uniform(cv::Mat& src, cv::Mat& dst, cv::Size dst_size, object_rect& effect_area)
+{
+    int w = src.cols;
+    int h = src.rows;
+    int dst_w = dst_size.width;
+    int dst_h = dst_size.height;
+    //std::cout << "src: (" << h << ", " << w << ")" << std::endl;
+    dst = cv::Mat(cv::Size(dst_w, dst_h), CV_8UC3, cv::Scalar(0));
+
+    float ratio_src = w * 1.0 / h;
+    float ratio_dst = dst_w * 1.0 / dst_h;
+
+    int tmp_w = 0;
+    int tmp_h = 0;
+    if (ratio_src > ratio_dst) {
+        tmp_w = dst_w;
+        tmp_h = floor((dst_w * 1.0 / w) * h);
+    }
+    else if (ratio_src < ratio_dst) {
+        tmp_h = dst_h;
+        tmp_w = floor((dst_h * 1.0 / h) * w);
+    }
+    else {
+        cv::resize(cv::InputArray(src), cv::OutputArray(dst), dst_size);
+        effect_area.x = 0;
+        effect_area.y = 0;
+        effect_area.width = dst_w;
+        effect_area.height = dst_h;
+        return 0;
+    }
+
+    //std::cout << "tmp: (" << tmp_h << ", " << tmp_w << ")" << std::endl;
+    cv::Mat tmp;
+    cv::resize(cv::InputArray(src), cv::OutputArray(tmp), cv::Size(tmp_w, tmp_h));
+
+    if (tmp_w != dst_w) {
+        int index_w = floor((dst_w - tmp_w) / 2.0);
+        //std::cout << "index_w: " << index_w << std::endl;
+        for (int i = 0; i < dst_h; i++) {
+            memcpy(dst.data + i * dst_w * 3 + index_w * 3, tmp.data + i * tmp_w * 3, tmp_w * 3);
+        }
+        effect_area.x = index_w;
+        effect_area.y = 0;
+        effect_area.width = tmp_w;
+        effect_area.height = tmp_h;
+    }
+    else if (tmp_h != dst_h) {
+        int index_h = floor((dst_h - tmp_h) / 2.0);
+        //std::cout << "index_h: " << index_h << std::endl;
+        memcpy(dst.data + index_h * dst_w * 3, tmp.data, tmp_w * tmp_h * 3);
+        effect_area.x = 0;
+        effect_area.y = index_h;
+        effect_area.width = tmp_w;
+        effect_area.height = tmp_h;
+    }
+    else {
+        printf("error\n");
+    }
+    //cv::imshow("dst", dst);
+    //cv::waitKey(0);
+    return 0;
+}
+
+object_rect letterbox_area(int src_w, int src_h, int dst_w, int dst_h)
+{
+    float ratio_src = src_w * 1.0 / src_h;
+    float ratio_dst = dst_w * 1.0 / dst_h;
+
+    object_rect effect_area = {0, 0, dst_w, dst_h};
+    if (ratio_src > ratio_dst) {
+        effect_area.height = floor((dst_w * 1.0 / src_w) * src_h);
+        effect_area.y = floor((dst_h - effect_area.height) / 2.0);
+    }
+    else if (ratio_src < ratio_dst) {
+        effect_area.width = floor((dst_h * 1.0 / src_h) * src_w);
+        effect_area.x = floor((dst_w - effect_area.width) / 2.0);
+    }
+    return effect_area;
+}
+
+// the two taps and the weight of the second one of every dst sample of a plane of src_size samples
+// scaled by scale, as byte offsets: bilinear, matching cv::resize INTER_LINEAR to within rounding
+// (the weights are float, OpenCV's are 11-bit fixed point)
+static void linear_taps(int dst_size, int src_size, double scale, int pix, std::vector<int>& ofs0, std::vector<int>& ofs1, std::vector<float>& alpha)
+{
+    ofs0.resize(dst_size);
+    ofs1.resize(dst_size);
+    alpha.resize(dst_size);
+    for (int d = 0; d < dst_size; d++)
+    {
+        float f = (float)((d + 0.5) * scale - 0.5);
+        int s = (int)floor(f);
+        f -= s;
+        if (s < 0) {
+            s = 0;
+            f = 0.f;
+        }
+        if (s >= src_size - 1) {
+            s = src_size - 1;
+            f = 0.f;
+        }
+        ofs0[d] = s * pix;
+        ofs1[d] = (std::min)(s + 1, src_size - 1) * pix;
+        alpha[d] = f;
+    }
+}
+
+// whether taps were built for this source, crop and letterbox
+static bool same_taps(const LetterboxTaps& taps, int layout, int src_w, int src_h, const cv::Rect& crop, int dst_w, int dst_h)
+{
+    return taps.layout == layout && taps.src_w == src_w && taps.src_h == src_h && taps.crop == crop
+        && taps.dst_w == dst_w && taps.dst_h == dst_h;
+}
+
+static void set_taps_key(LetterboxTaps& taps, int layout, int src_w, int src_h, const cv::Rect& crop, int dst_w, int dst_h)
+{
+    taps.layout = layout;
+    taps.src_w = src_w;
+    taps.src_h = src_h;
+    taps.crop = crop;
+    taps.dst_w = dst_w;
+    taps.dst_h = dst_h;
+}
+
+void letterbox_normalize(const cv::Mat& src, int dst_w, int dst_h, const float* mean_vals, const float* norm_vals,
+                         ncnn::Mat& in, object_rect& effect_area, LetterboxTaps& taps, ncnn::Allocator* allocator)
+{
+    // bilinear taps matching cv::resize INTER_LINEAR to within rounding, built once per frame size
+    if (!same_taps(taps, -1, src.cols, src.rows, cv::Rect(), dst_w, dst_h))
+    {
+        set_taps_key(taps, -1, src.cols, src.rows, cv::Rect(), dst_w, dst_h);
+        taps.effect_area = letterbox_area(src.cols, src.rows, dst_w, dst_h);
+        linear_taps(taps.effect_area.width, src.cols, (double)src.cols / taps.effect_area.width, 3, taps.x0, taps.x1, taps.ax);
+        linear_taps(taps.effect_area.height, src.rows, (double)src.rows / taps.effect_area.height, 1, taps.y0, taps.y1, taps.ay);
+    }
+    effect_area = taps.effect_area;
+    in.create(dst_w, dst_h, 3, 4u, allocator);
+
+    // the black padding after normalization
+    float pad[3];
+    for (int c = 0; c < 3; c++)
+        pad[c] = (0.f - mean_vals[c]) * norm_vals[c];
+
+    const int tmp_w = effect_area.width;
+    const int tmp_h = effect_area.height;
+    for (int y = 0; y < dst_h; y++)
+    {
+        float* out0 = in.channel(0).row(y);
+        float* out1 = in.channel(1).row(y);
+        float* out2 = in.channel(2).row(y);
+
+        const int dy = y - effect_area.y;
+        if (dy < 0 || dy >= tmp_h)
+        {
+            for (int x = 0; x < dst_w; x++)
+            {
+                out0[x] = pad[0];
+                out1[x] = pad[1];
+                out2[x] = pad[2];
+            }
+            continue;
+        }
+
+        const unsigned char* row0 = src.ptr<unsigned char>(taps.y0[dy]);
+        const unsigned char* row1 = src.ptr<unsigned char>(taps.y1[dy]);
+        const float fy = taps.ay[dy];
+
+        for (int x = 0; x < effect_area.x; x++)
+        {
+            out0[x] = pad[0];
+            out1[x] = pad[1];
+            out2[x] = pad[2];
+        }
+        for (int dx = 0; dx < tmp_w; dx++)
+        {
+            const int x0 = taps.x0[dx];
+            const int x1 = taps.x1[dx];
+            const float ax = taps.ax[dx];
+            float v[3];
+            for (int c = 0; c < 3; c++)
+            {
+                float top = row0[x0 + c] + (row0[x1 + c] - row0[x0 + c]) * ax;
+                float bottom = row1[x0 + c] + (row1[x1 + c] - row1[x0 + c]) * ax;
+                // rounded to the value the 8-bit letterbox of resize_uniform would hold
+                v[c] = floorf(top + (bottom - top) * fy + 0.5f);
+            }
+            const int x = effect_area.x + dx;
+            out0[x] = (v[0] - mean_vals[0]) * norm_vals[0];
+            out1[x] = (v[1] - mean_vals[1]) * norm_vals[1];
+            out2[x] = (v[2] - mean_vals[2]) * norm_vals[2];
+        }
+        for (int x = effect_area.x + tmp_w; x < dst_w; x++)
+        {
+            out0[x] = pad[0];
+            out1[x] = pad[1];
+            out2[x] = pad[2];
+        }
+    }
+}
+
+// where the planes of a YUV frame are, in bytes: the step between two rows and between two samples
+struct YuvPlanes
+{
+    const unsigned char* y;
+    const unsigned char* u;
+    const unsigned char* v;
+    int y_step;
+    int y_pix;
+    int uv_step;
+    int uv_pix;
+    int width; // luma size
+    int height;
+    int uv_width; // chroma size
+    int uv_height;
+};
+
+static YuvPlanes full_yuv_planes(const cv::Mat& src, YuvLayout layout)
+{
+    YuvPlanes planes;
+    const unsigned char* data = src.ptr<unsigned char>(0);
+    const int step = (int)src.step[0];
+    planes.y = data;
+    planes.y_step = step;
+    if (layout == YUV_YUYV)
+    {
+        planes.width = src.cols;
+        planes.height = src.rows;
+        planes.y_pix = 2;
+        planes.u = data + 1;
+        planes.v = data + 3;
+        planes.uv_step = step;
+        planes.uv_pix = 4;
+        planes.uv_width = src.cols / 2;
+        planes.uv_height = src.rows;
+        return planes;
+    }
+
+    planes.width = src.cols;
+    planes.height = src.rows * 2 / 3;
+    planes.y_pix = 1;
+    planes.uv_width = planes.width / 2;
+    planes.uv_height = planes.height / 2;
+    const unsigned char* chroma = data + (size_t)step * planes.height;
+    if (layout == YUV_NV12)
+    {
+        planes.u = chroma;
+        planes.v = chroma + 1;
+        planes.uv_step = step;
+        planes.uv_pix = 2;
+    } else
+    {
+        planes.u = chroma;
+        planes.v = chroma + (size_t)(step / 2) * planes.uv_height;
+        planes.uv_step = step / 2;
+        planes.uv_pix = 1;
+    }
+    return planes;
+}
+
+// the planes of the crop rectangle, whose corners are on even pixels
+static YuvPlanes yuv_planes(const cv::Mat& src, YuvLayout layout, const cv::Rect& crop)
+{
+    YuvPlanes planes = full_yuv_planes(src, layout);
+    if (crop.area() == 0)
+        return planes;
+
+    const int uv_y = planes.uv_height == planes.height ? crop.y : crop.y / 2;
+    planes.y += (size_t)crop.y * planes.y_step + (size_t)crop.x * planes.y_pix;
+    planes.u += (size_t)uv_y * planes.uv_step + (size_t)(crop.x / 2) * planes.uv_pix;
+    planes.v += (size_t)uv_y * planes.uv_step + (size_t)(crop.x / 2) * planes.uv_pix;
+    planes.uv_height = planes.uv_height == planes.height ? crop.height : crop.height / 2;
+    planes.uv_width = crop.width / 2;
+    planes.width = crop.width;
+    planes.height = crop.height;
+    return planes;
+}
+
+cv::Rect clip_crop(const cv::Rect& crop, int width, int height, bool even)
+{
+    cv::Rect clipped = crop & cv::Rect(0, 0, width, height);
+    if (clipped.area() == 0)
+        clipped = cv::Rect(0, 0, width, height);
+    if (!even)
+        return clipped;
+
+    int x1 = (clipped.x + 1) & ~1;
+    int y1 = (clipped.y + 1) & ~1;
+    int x2 = (clipped.x + clipped.width) & ~1;
+    int y2 = (clipped.y + clipped.height) & ~1;
+    if (x2 - x1 < 2 || y2 - y1 < 2)
+        return cv::Rect(0, 0, width & ~1, height & ~1);
+    return cv::Rect(x1, y1, x2 - x1, y2 - y1);
+}
+
+static inline float lerp_rows(const unsigned char* row0, const unsigned char* row1, int x0, int x1, float ax, float ay)
+{
+    float top = row0[x0] + (row0[x1] - row0[x0]) * ax;
+    float bottom = row1[x0] + (row1[x1] - row1[x0]) * ax;
+    return top + (bottom - top) * ay;
+}
+
+static inline float clamp_round(float v)
+{
+    return floorf((std::min)((std::max)(v, 0.f), 255.f) + 0.5f);
+}
+
+void letterbox_normalize_yuv(const cv::Mat& src, YuvLayout layout, const cv::Rect& crop, int dst_w, int dst_h, const float* mean_vals, const float* norm_vals,
+                             ncnn::Mat& in, object_rect& effect_area, LetterboxTaps& taps, ncnn::Allocator* allocator)
+{
+    const YuvPlanes planes = yuv_planes(src, layout, crop);
+
+    // luma and chroma taps of the letterboxed columns and rows, the chroma grid is sampled at the
+    // position of the luma sample like the chroma upsampling of cv::cvtColor followed by cv::resize.
+    // They only depend on the frame geometry, so they are kept until it changes
+    if (!same_taps(taps, layout, src.cols, src.rows, crop, dst_w, dst_h))
+    {
+        set_taps_key(taps, layout, src.cols, src.rows, crop, dst_w, dst_h);
+        taps.effect_area = letterbox_area(planes.width, planes.height, dst_w, dst_h);
+        const int tmp_w = taps.effect_area.width;
+        const int tmp_h = taps.effect_area.height;
+        const double scale_x = (double)planes.width / tmp_w;
+        const double scale_y = (double)planes.height / tmp_h;
+        linear_taps(tmp_w, planes.width, scale_x, planes.y_pix, taps.x0, taps.x1, taps.ax);
+        linear_taps(tmp_w, planes.uv_width, scale_x * planes.uv_width / planes.width, planes.uv_pix, taps.c_x0, taps.c_x1, taps.c_ax);
+        linear_taps(tmp_h, planes.height, scale_y, 1, taps.y0, taps.y1, taps.ay);
+        linear_taps(tmp_h, planes.uv_height, scale_y * planes.uv_height / planes.height, 1, taps.c_y0, taps.c_y1, taps.c_ay);
+    }
+    effect_area = taps.effect_area;
+    in.create(dst_w, dst_h, 3, 4u, allocator);
+
+    float pad[3];
+    for (int c = 0; c < 3; c++)
+        pad[c] = (0.f - mean_vals[c]) * norm_vals[c];
+
+    const int tmp_w = effect_area.width;
+    const int tmp_h = effect_area.height;
+
+    for (int y = 0; y < dst_h; y++)
+    {
+        float* out0 = in.channel(0).row(y);
+        float* out1 = in.channel(1).row(y);
+        float* out2 = in.channel(2).row(y);
+
+        const int dy = y - effect_area.y;
+        if (dy < 0 || dy >= tmp_h)
+        {
+            for (int x = 0; x < dst_w; x++)
+            {
+                out0[x] = pad[0];
+                out1[x] = pad[1];
+                out2[x] = pad[2];
+            }
+            continue;
+        }
+
+        const unsigned char* y_row0 = planes.y + (size_t)taps.y0[dy] * planes.y_step;
+        const unsigned char* y_row1 = planes.y + (size_t)taps.y1[dy] * planes.y_step;
+        const size_t c_row0 = (size_t)taps.c_y0[dy] * planes.uv_step;
+        const size_t c_row1 = (size_t)taps.c_y1[dy] * planes.uv_step;
+        const float ay = taps.ay[dy];
+        const float cy = taps.c_ay[dy];
+
+        for (int x = 0; x < effect_area.x; x++)
+        {
+            out0[x] = pad[0];
+            out1[x] = pad[1];
+            out2[x] = pad[2];
+        }
+        for (int dx = 0; dx < tmp_w; dx++)
+        {
+            float luma = lerp_rows(y_row0, y_row1, taps.x0[dx], taps.x1[dx], taps.ax[dx], ay);
+            float u = lerp_rows(planes.u + c_row0, planes.u + c_row1, taps.c_x0[dx], taps.c_x1[dx], taps.c_ax[dx], cy) - 128.f;
+            float v = lerp_rows(planes.v + c_row0, planes.v + c_row1, taps.c_x0[dx], taps.c_x1[dx], taps.c_ax[dx], cy) - 128.f;
+
+            // BT.601 limited range, the coefficients of cv::COLOR_YUV2BGR_NV12
+            float l = (std::max)(luma - 16.f, 0.f) * 1.164f;
+            float b = clamp_round(l + 2.018f * u);
+            float g = clamp_round(l - 0.813f * v - 0.391f * u);
+            float r = clamp_round(l + 1.596f * v);
+
+            const int x = effect_area.x + dx;
+            out0[x] = (b - mean_vals[0]) * norm_vals[0];
+            out1[x] = (g - mean_vals[1]) * norm_vals[1];
+            out2[x] = (r - mean_vals[2]) * norm_vals[2];
+        }
+        for (int x = effect_area.x + tmp_w; x < dst_w; x++)
+        {
+            out0[x] = pad[0];
+            out1[x] = pad[1];
+            out2[x] = pad[2];
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef LETTERBOX_H
+#define LETTERBOX_H
+
+#include <opencv2/core/core.hpp>
+#include <mat.h>
+#include <vector>
+
+// the area of the letterboxed image covered by the source frame
+struct object_rect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// scale src to fit dst_size keeping its aspect ratio, centered and padded with black
+int resize_uniform(cv::Mat& src, cv::Mat& dst, cv::Size dst_size, object_rect& effect_area);
+
+// where resize_uniform puts a src_w x src_h frame in the dst_w x dst_h letterbox, without resizing anything
+object_rect letterbox_area(int src_w, int src_h, int dst_w, int dst_h);
+
+// the sampling taps of letterbox_normalize and letterbox_normalize_yuv, kept by the caller between
+// frames and only rebuilt when the source size, crop, layout or letterbox size changes. Columns are
+// byte offsets into a row, rows are row indices, and each tap pair comes with the weight of the
+// second tap; the chroma taps are only used for the YUV layouts.
+struct LetterboxTaps
+{
+    // the key: layout is a YuvLayout or -1 for BGR, crop is empty for the whole frame
+    int layout = -1;
+    int src_w = 0;
+    int src_h = 0;
+    cv::Rect crop;
+    int dst_w = 0;
+    int dst_h = 0;
+
+    object_rect effect_area = {0, 0, 0, 0};
+    std::vector<int> x0, x1, y0, y1;
+    std::vector<float> ax, ay;
+    std::vector<int> c_x0, c_x1, c_y0, c_y1;
+    std::vector<float> c_ax, c_ay;
+};
+
+// resize_uniform and the mean/norm normalization fused into one pass: the BGR frame is sampled
+// bilinearly, matching cv::resize to within rounding (float weights where OpenCV uses 11-bit fixed
+// point, so a level may differ by one), normalized and written as planar float straight into in,
+// whose buffer is reused when it already has the dst_w x dst_h x 3 shape
+void letterbox_normalize(const cv::Mat& src, int dst_w, int dst_h, const float* mean_vals, const float* norm_vals,
+                         ncnn::Mat& in, object_rect& effect_area, LetterboxTaps& taps, ncnn::Allocator* allocator = 0);
+
+// the YUV layouts the camera frames may arrive in, as OpenCV holds them in a cv::Mat:
+// NV12/I420 as a (height * 3 / 2) x width CV_8UC1 mat, the chroma planes below the luma plane,
+// YUYV as a height x width CV_8UC2 mat
+enum YuvLayout
+{
+    YUV_NV12 = 0,
+    YUV_I420 = 1,
+    YUV_YUYV = 2
+};
+
+// letterbox_normalize for the crop rectangle of a YUV frame (the whole frame if crop is empty, its
+// corners must be on even pixels): the planes are resampled to the letterbox in YUV space and only
+// the dst_w x dst_h result is converted to BGR (BT.601 like cv::cvtColor), rounded to 8 bits,
+// normalized and written planar into in. The colour conversion costs in proportion to the network
+// input instead of the camera resolution.
+void letterbox_normalize_yuv(const cv::Mat& src, YuvLayout layout, const cv::Rect& crop, int dst_w, int dst_h, const float* mean_vals, const float* norm_vals,
+                             ncnn::Mat& in, object_rect& effect_area, LetterboxTaps& taps, ncnn::Allocator* allocator = 0);
+
+// crop inside a width x height frame, the whole frame if crop is empty or outside of it. With even,
+// its corners are moved inwards to even pixels as the chroma of the YUV layouts requires
+cv::Rect clip_crop(const cv::Rect& crop, int width, int height, bool even = false);
+
+#endif //LETTERBOX_H
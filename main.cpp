@@ -3,12 +3,31 @@
 #include <QDebug>
 #include <ncnn/include/net.h>
 #include <nanodet.h>
+#include "letterbox.h"
+#include "bounded_queue.h"
+#include "camera_scheduler.h"
+#include "detection_gate.h"
+#include "latest_frame.h"
+#include "v4l2_capture.h"
+#include "tiled_detection.h"
+#include "box_tracker.h"
+#include "box_flow.h"
+#include "door_events.h"
+#include "result_ring.h"
+#include "door_results.h"
+#include "frame_bus.h"
 #include <vector>
+#include <thread>
+#include <algorithm>
 #include <json.h>
 #include <iostream>
 #include <fstream>
 #include <sys/shm.h>
 #include <sys/sem.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <cstdlib>
 #include <cstring>
 
@@ -17,37 +36,72 @@ using namespace Json;
 using namespace cv;
 #define NMS_THRESHOLD 0.5F
 
-// 结构体，用于在共享内存中存储消息
-struct Message {
-    bool isWritten;
-    char content[1024 * 10];
-};
-
 int M_SHARED_MEMORY_ID;
 int M_SHARED_SEM_ID;
-Message * M_MESSAGE_ID;
-
-struct object_rect {
-    int x;
-    int y;
-    int width;
-    int height;
+// the results published to the other applications, see result_ring.h
+ResultRingHeader * M_RESULT_RING;
+size_t M_RESULT_RING_SIZE;
+bool M_SYSV_TRANSPORT; // the SysV segment and semaphore instead of the POSIX shared memory object
+// the camera frames published to the other applications, see frame_bus.h; null when the bus is off
+FrameBusHeader * M_FRAME_BUS;
+size_t M_FRAME_BUS_SIZE;
+
+struct CameraConfig {
+    int id;
+    int deadline_ms; // the longest this camera should go without a detection
+    string device; // v4l2 backend: the capture node or raw frame file, /dev/video<id> if empty
+    cv::Rect roi; // the part of the frame the doors are in, cropped before the letterbox; empty for the whole frame
+    TileConfig tiles; // the roi is detected as overlapping tiles, for doors too small in a single letterbox
 };
 
+struct FrameBusConfig {
+    bool enabled = false;
+    string name = "/door_frames"; // the shm_open name of the bus
+    int slots = 8; // frames the bus holds, at least one per camera plus the ones the consumers pin
+    int max_width = 1920; // the largest frame, larger ones are not published
+    int max_height = 1080;
+    bool annotated = true; // the frames as drawn on the screen, otherwise as captured
+    int hold_ms = 1000; // the longest a consumer may pin a frame, then it is taken back; 0 for never
+};
 
 struct DoorDet_config {
     float det_threshold;
+    int input_size[2] = {416, 416}; // network input height and width, smaller ones suit cameras with a tight roi
     int compute_every_frames;
+    MotionGateConfig motion_gate; // replaces compute_every_frames when enabled
     bool sync_results_frame;
     int sharedMemID;
     int sharedSemID;
-    bool sync_waiting_sharedMemory_consumed;
+    string sharedMemTransport = "posix"; // posix (shm_open object, futex wake-up) or sysv (the key, plus the semaphore)
+    string sharedMemName = "/door_results"; // the shm_open name of the posix transport
+    int sharedMemSlots = 16; // messages the shared memory ring holds, a reader further behind loses the oldest
+    int sharedMemSlotSize = 1024 * 10; // the largest message, larger ones are dropped
+    string sharedMemFormat = "binary"; // binary records of door_results.h, or json as in the logs
+    string execution_profile_name;
+    ExecutionProfile execution_profile;
+    string model_precision = "fp32"; // fp32 or int8
+    string model_param = "/home/teamhd/opencvTest_QT/ncnn_models/nanodet_door.param"; // the param/bin pair of the selected precision
+    string model_bin = "/home/teamhd/opencvTest_QT/ncnn_models/nanodet_door.bin";
+    QueueConfig capture_queue = {2, QUEUE_DROP_OLDEST}; // captured frames waiting for the detector
+    QueueConfig result_queue = {4, QUEUE_BLOCK}; // detected frames waiting to be drawn and published
+    bool latest_frame_capture = false; // cameras: the detector takes the newest frame instead of the capture queue
+    vector<CameraConfig> cameras; // used when no camera id is given on the command line
+    int camera_deadline_ms = 500;
+    int inference_workers = 2; // threads running the detector in multi-camera mode
+    int tile_workers = 4; // threads running the tiles of the tiled cameras, shared by all of them
+    string capture_backend = "opencv"; // opencv (cv::VideoCapture) or v4l2 (mmap driver buffers, one epoll loop)
+    V4l2CameraConfig v4l2; // the stream settings of every camera of the v4l2 backend
+    TrackerConfig tracker; // carries the boxes of every camera across the skipped frames with stable ids
+    FlowConfig flow; // moves the boxes of the skipped frames by optical flow, in place of the tracker prediction
+    DoorEventConfig door_events; // publishes the debounced status changes of the doors instead of every frame
+    FrameBusConfig frame_bus; // shares the camera frames with the other applications
 };
 
 struct DoorDetResultInfo {
     object_rect boundingBox;
     int label; // 0 for close, 1 for open
     float conf; // the detected confidence
+    int track_id; // the id of the door given by the tracker, 0 when not tracked
 };
 
 struct FusedResultInfo {
@@ -57,11 +111,81 @@ struct FusedResultInfo {
 };
 
 
-bool initSharedMemory(DoorDet_config config)
+// a POSIX shared memory object of size bytes, the result ring or the frame bus. It is left in place
+// when the detector stops, so a restarted detector continues the same one and the attached readers
+// notice nothing; one of another size is handed to closeOld (its readers are told to open the new one)
+// and replaced
+static void* openPosixObject(const char* name, size_t size, void (*closeOld)(void* memory, size_t size))
+{
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0666);
+    if (fd == -1)
+        return nullptr;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size != 0 && (size_t)info.st_size != size)
+    {
+        void* old = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (old != MAP_FAILED)
+        {
+            closeOld(old, info.st_size);
+            munmap(old, info.st_size);
+        }
+        close(fd);
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+        if (fd == -1)
+            return nullptr;
+    }
+    void* memory = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return memory == MAP_FAILED ? nullptr : memory;
+}
+
+static void closeOldRing(void* memory, size_t size)
+{
+    if (size >= sizeof(ResultRingHeader) && result_ring_ready((ResultRingHeader*)memory))
+        result_ring_stop((ResultRingHeader*)memory, 1);
+}
+
+static void closeOldFrameBus(void* memory, size_t size)
+{
+    if (size >= sizeof(FrameBusHeader) && frame_bus_ready((FrameBusHeader*)memory))
+        frame_bus_stop((FrameBusHeader*)memory, 1);
+}
+
+bool initSharedMemory(const DoorDet_config& config)
 {
-    printf("creating sharedMemory at ID:%d \n", config.sharedMemID);
     bool resultCode = true;
-    M_SHARED_MEMORY_ID = shmget(config.sharedMemID, sizeof(Message), IPC_CREAT | 0666);
+    M_RESULT_RING_SIZE = result_ring_size(config.sharedMemSlots, config.sharedMemSlotSize);
+    M_SYSV_TRANSPORT = config.sharedMemTransport == "sysv";
+    if (!M_SYSV_TRANSPORT)
+    {
+        printf("creating sharedMemory at %s \n", config.sharedMemName.c_str());
+        M_RESULT_RING = (ResultRingHeader*)openPosixObject(config.sharedMemName.c_str(), M_RESULT_RING_SIZE, closeOldRing);
+        if (M_RESULT_RING == nullptr)
+        {
+            printf("error: failed to create shared memory! \n");
+            resultCode = false;
+        } else
+        {
+            int continued = result_ring_init(M_RESULT_RING, config.sharedMemSlots, config.sharedMemSlotSize);
+            printf("%s the shared memory ring (writer start %llu) \n", continued ? "continued" : "created",
+                   (unsigned long long)M_RESULT_RING->generation);
+        }
+        return resultCode;
+    }
+
+    printf("creating sharedMemory at ID:%d \n", config.sharedMemID);
+    M_SHARED_MEMORY_ID = shmget(config.sharedMemID, M_RESULT_RING_SIZE, IPC_CREAT | 0666);
+    if (M_SHARED_MEMORY_ID == -1 && errno == EINVAL)
+    {
+        // a smaller segment of an older version or ring geometry holds the key, it is replaced
+        int old_id = shmget(config.sharedMemID, 0, 0666);
+        if (old_id != -1)
+            shmctl(old_id, IPC_RMID, nullptr);
+        M_SHARED_MEMORY_ID = shmget(config.sharedMemID, M_RESULT_RING_SIZE, IPC_CREAT | 0666);
+    }
     if (M_SHARED_MEMORY_ID == -1)
     {
         printf("error: failed to create shared memory! \n");
@@ -69,11 +193,17 @@ bool initSharedMemory(DoorDet_config config)
     }
 
     // connect to the shared memory
-    M_MESSAGE_ID = (Message *)shmat(M_SHARED_MEMORY_ID, nullptr, 0);
-    if (M_MESSAGE_ID == (Message *) -1)
+    M_RESULT_RING = (ResultRingHeader *)shmat(M_SHARED_MEMORY_ID, nullptr, 0);
+    if (M_RESULT_RING == (ResultRingHeader *) -1)
     {
         printf("error: failed to attach the shared memory! \n");
+        M_RESULT_RING = nullptr;
         resultCode = false;
+    } else
+    {
+        // a released segment was removed (IPC_RMID) and the ring starts afresh, the readers map it
+        // again; only the segment of a run which did not release it is continued with the cursors
+        result_ring_init(M_RESULT_RING, config.sharedMemSlots, config.sharedMemSlotSize);
     }
 
     // create the shared sem
@@ -84,9 +214,6 @@ bool initSharedMemory(DoorDet_config config)
         resultCode = false;
     }
 
-    // init the semaphore
-    semctl(M_SHARED_SEM_ID, 0, SETVAL, 0);
-
     // started the sharedMemory processing
     if (resultCode)
     {
@@ -99,27 +226,53 @@ bool initSharedMemory(DoorDet_config config)
     return resultCode;
 }
 
-void writeToSharedMemory(string content, DoorDet_config config)
+// publishes one message to the ring without ever waiting for the readers, a reader too slow loses
+// the oldest messages (counted in the overruns of the ring) instead of stalling the detection. The
+// sleeping readers are woken through the futex of the ring, with the sysv transport the semaphore is
+// posted as well
+void writeToSharedMemory(const string& content, const DoorDet_config& config)
 {
-    // 获取信号量的当前值
+    if (M_RESULT_RING == nullptr)
+        return;
+    if (!result_ring_write(M_RESULT_RING, content.c_str(), (uint32_t)content.size()))
+    {
+        printf("warning: a message of %d bytes is larger than the shared memory slots and was dropped \n", (int)content.size());
+        return;
+    }
+    if (!M_SYSV_TRANSPORT)
+        return;
+
+    // wakes a reader waiting on the semaphore, it then reads the ring up to its head. Never blocks,
+    // a semaphore nobody takes stops counting at its maximum
     struct sembuf sops;
     sops.sem_num = 0;
-    sops.sem_op = 0;
-    sops.sem_flg = 0;
-    if(config.sync_waiting_sharedMemory_consumed)
-        semop(M_SHARED_SEM_ID, &sops, 1);
-
-    // 写入消息到共享内存
-    strncpy(M_MESSAGE_ID->content, content.c_str(), sizeof(M_MESSAGE_ID->content));
-    M_MESSAGE_ID->isWritten = true;
-
-    // 释放信号量
     sops.sem_op = 1;
+    sops.sem_flg = IPC_NOWAIT;
     semop(M_SHARED_SEM_ID, &sops, 1);
 }
 
 void releaseSharedMemory() {
-    shmdt(M_MESSAGE_ID);
+    if (M_RESULT_RING == nullptr)
+        return;
+    // the system calls the publishing cost: the futex wake-ups, and one semop per message with sysv
+    unsigned long long published = M_RESULT_RING->head;
+    unsigned long long wakeups = M_RESULT_RING->wakeups;
+    printf("shared memory ring: published:%llu overruns:%llu oversized:%llu futex wake-ups:%llu (%.3f system calls per publish)\n",
+           published, (unsigned long long)M_RESULT_RING->overruns, (unsigned long long)M_RESULT_RING->oversized, wakeups,
+           published > 0 ? (double)(wakeups + (M_SYSV_TRANSPORT ? published : 0)) / published : 0.0);
+
+    if (!M_SYSV_TRANSPORT)
+    {
+        // the object stays for the next run, the readers keep waiting on it
+        result_ring_stop(M_RESULT_RING, 0);
+        munmap(M_RESULT_RING, M_RESULT_RING_SIZE);
+        M_RESULT_RING = nullptr;
+        return;
+    }
+
+    result_ring_stop(M_RESULT_RING, 1);
+    shmdt(M_RESULT_RING);
+    M_RESULT_RING = nullptr;
 
     // 删除共享内存
     shmctl(M_SHARED_MEMORY_ID, IPC_RMID, nullptr);
@@ -128,7 +281,84 @@ void releaseSharedMemory() {
     semctl(M_SHARED_SEM_ID, 0, IPC_RMID);
 }
 
-void draw_bboxes(const cv::Mat& bgr, DoorDet_config config, const std::vector<BoxInfo>& bboxes, object_rect effect_roi, char* winName, int camera_id = 0, bool savingLogs = true, char* logPath = nullptr, uint64_t timeStamp = 0, bool append = false);
+// cameras: the cameras which will publish, the slots are raised to two per camera when fewer
+bool initFrameBus(const FrameBusConfig& config, int cameras)
+{
+    if (!config.enabled)
+        return true;
+    printf("creating the frame bus at %s \n", config.name.c_str());
+    // the newest frame of every camera keeps its slot, the writer needs others to fill and the
+    // consumers to pin: with one slot per camera or less every frame is dropped
+    const int published = std::min(std::max(cameras, 1), FRAME_BUS_MAX_CAMERAS);
+    int slots = config.slots;
+    if (slots < 2 * published)
+    {
+        slots = 2 * published;
+        printf("warning: %d frame bus slots are too few for %d cameras, %d are used \n", config.slots, published, slots);
+    }
+    const uint32_t frame_bytes = (uint32_t)config.max_width * config.max_height * 3;
+    M_FRAME_BUS_SIZE = frame_bus_size(slots, frame_bytes);
+    M_FRAME_BUS = (FrameBusHeader*)openPosixObject(config.name.c_str(), M_FRAME_BUS_SIZE, closeOldFrameBus);
+    if (M_FRAME_BUS == nullptr)
+    {
+        printf("error: failed to create the frame bus! \n");
+        return false;
+    }
+    int continued = frame_bus_init(M_FRAME_BUS, slots, frame_bytes);
+    printf("%s the frame bus, %d slots of %ux%u (writer start %llu) \n", continued ? "continued" : "created", slots,
+           config.max_width, config.max_height, (unsigned long long)M_FRAME_BUS->generation);
+    return true;
+}
+
+void releaseFrameBus()
+{
+    if (M_FRAME_BUS == nullptr)
+        return;
+    printf("frame bus: published:%llu dropped:%llu oversized:%llu reclaimed:%llu futex wake-ups:%llu\n",
+           (unsigned long long)M_FRAME_BUS->sequence, (unsigned long long)M_FRAME_BUS->dropped,
+           (unsigned long long)M_FRAME_BUS->oversized, (unsigned long long)M_FRAME_BUS->reclaimed,
+           (unsigned long long)M_FRAME_BUS->wakeups);
+    // the object stays for the next run, like the result ring
+    frame_bus_stop(M_FRAME_BUS, 0);
+    munmap(M_FRAME_BUS, M_FRAME_BUS_SIZE);
+    M_FRAME_BUS = nullptr;
+}
+
+// a slot of the frame bus for the frame of the packet, its pixels as a Mat to draw or copy the frame
+// into; empty with no bus, or when the frame is too large or every slot is pinned (it is not published)
+cv::Mat beginBusFrame(const FrameBusConfig& config, const FramePacket& packet, int& slot)
+{
+    slot = -1;
+    if (M_FRAME_BUS == nullptr)
+        return cv::Mat();
+    if ((size_t)packet.width() * packet.height() * 3 > M_FRAME_BUS->frame_bytes)
+    {
+        __atomic_fetch_add(&M_FRAME_BUS->oversized, 1, __ATOMIC_RELAXED);
+        return cv::Mat();
+    }
+    const uint64_t hold_ns = config.hold_ms > 0 ? (uint64_t)config.hold_ms * 1000000ull : UINT64_MAX;
+    slot = frame_bus_begin(M_FRAME_BUS, (uint32_t)packet.camera_slot, hold_ns);
+    if (slot < 0)
+        return cv::Mat();
+    return cv::Mat(packet.height(), packet.width(), CV_8UC3, frame_bus_pixels(M_FRAME_BUS, slot));
+}
+
+// publishes the frame filled into the slot of beginBusFrame with the metadata of its packet
+void commitBusFrame(int slot, const FramePacket& packet, uint64_t detections, bool annotated)
+{
+    FrameBusSlot* frame = frame_bus_slot(M_FRAME_BUS, slot);
+    frame->timestamp_ms = packet.timeStamp;
+    frame->detection_sequence = detections;
+    frame->camera_idx = packet.camera_idx;
+    frame->width = packet.width();
+    frame->height = packet.height();
+    frame->stride = packet.width() * 3;
+    frame->format = FRAME_BUS_BGR24;
+    frame->flags = (annotated ? FRAME_BUS_ANNOTATED : 0) | (packet.computed ? FRAME_BUS_COMPUTED : 0);
+    frame_bus_commit(M_FRAME_BUS, slot);
+}
+
+void draw_bboxes(const cv::Mat& bgr, const DoorDet_config& config, const std::vector<BoxInfo>& bboxes, object_rect effect_roi, char* winName, int camera_id = 0, bool savingLogs = true, char* logPath = nullptr, uint64_t timeStamp = 0, bool append = false, cv::Mat* canvas = nullptr);
 //声明
 string WriteFileJson(char* filePath, FusedResultInfo info, bool append);
 
@@ -151,6 +381,8 @@ string WriteFileJson(char* filePath, FusedResultInfo info, bool append)
         box["height"] = Json::Value(item.boundingBox.height);
         box["status"] = Json::Value(item.label);
         box["confidence"] = Json::Value(item.conf);
+        if (item.track_id > 0)
+            box["track_id"] = Json::Value(item.track_id);
         root["doors"].append(box);
         if (item.label > 0)
             anyDoorOpen = true;
@@ -184,6 +416,181 @@ string WriteFileJson(char* filePath, FusedResultInfo info, bool append)
     return dataStr;
 }
 
+// the door list of a frame as a binary record of door_results.h, for shared_memory_format "binary"
+string EncodeResultRecord(const FusedResultInfo& info)
+{
+    DoorResultRecord record = {};
+    record.magic = DOOR_RESULTS_MAGIC;
+    record.version = DOOR_RESULTS_VERSION;
+    record.kind = DOOR_RESULTS_FRAME;
+    record.camera_idx = info.camera_idx;
+    record.door_count = (uint32_t)info.doorInfoArray.size();
+    record.timestamp_ms = info.timeStamp;
+    record.entry_size = sizeof(DoorResultEntry);
+
+    string message(door_results_size(record.door_count), '\0');
+    DoorResultEntry* doors = (DoorResultEntry*)&message[sizeof(DoorResultRecord)];
+    for (size_t i = 0; i < info.doorInfoArray.size(); i++)
+    {
+        const DoorDetResultInfo& item = info.doorInfoArray[i];
+        DoorResultEntry& door = doors[i];
+        door.x = (float)item.boundingBox.x;
+        door.y = (float)item.boundingBox.y;
+        door.width = (float)item.boundingBox.width;
+        door.height = (float)item.boundingBox.height;
+        door.confidence = item.conf;
+        door.status = item.label;
+        door.previous_status = item.label;
+        door.track_id = item.track_id;
+        if (item.label > 0)
+            record.flags |= DOOR_RESULTS_ANY_OPEN;
+    }
+    memcpy(&message[0], &record, sizeof(record));
+    return message;
+}
+
+// the status changes of one camera as a binary record of door_results.h, the transitions first and
+// on a heartbeat every door after them
+string EncodeEventRecord(int camera_idx, uint64_t timeStamp, const DoorEvents& events)
+{
+    DoorResultRecord record = {};
+    record.magic = DOOR_RESULTS_MAGIC;
+    record.version = DOOR_RESULTS_VERSION;
+    record.kind = events.heartbeat ? DOOR_RESULTS_HEARTBEAT : DOOR_RESULTS_TRANSITION;
+    record.camera_idx = camera_idx;
+    record.door_count = (uint32_t)(events.transitions.size() + events.doors.size());
+    record.timestamp_ms = timeStamp;
+    record.flags = events.any_door_open ? DOOR_RESULTS_ANY_OPEN : 0;
+    record.entry_size = sizeof(DoorResultEntry);
+
+    string message(door_results_size(record.door_count), '\0');
+    memcpy(&message[0], &record, sizeof(record));
+    DoorResultEntry* doors = (DoorResultEntry*)&message[sizeof(DoorResultRecord)];
+    for (size_t i = 0; i < record.door_count; i++)
+    {
+        const bool transition = i < events.transitions.size();
+        const DoorStatus& item = transition ? events.transitions[i] : events.doors[i - events.transitions.size()];
+        DoorResultEntry& door = doors[i];
+        door.x = item.box.x1;
+        door.y = item.box.y1;
+        door.width = item.box.x2 - item.box.x1;
+        door.height = item.box.y2 - item.box.y1;
+        door.confidence = item.box.score;
+        door.status = item.status;
+        door.previous_status = item.previous;
+        door.door_id = item.door_id;
+        door.track_id = item.box.track_id;
+        door.flags = transition ? DOOR_ENTRY_TRANSITION : 0;
+    }
+    return message;
+}
+
+// the status changes of the doors of one camera, and on a heartbeat the status of all of them, in
+// the door layout of WriteFileJson plus the id of every door and the status it changed from
+string WriteEventJson(char* filePath, int camera_idx, uint64_t timeStamp, const DoorEvents& events, bool append)
+{
+    auto door_json = [](const DoorStatus& door, bool transition) {
+        Json::Value box;
+        box["door_id"] = Json::Value(door.door_id);
+        box["x"] = Json::Value((int)door.box.x1);
+        box["y"] = Json::Value((int)door.box.y1);
+        box["width"] = Json::Value((int)(door.box.x2 - door.box.x1));
+        box["height"] = Json::Value((int)(door.box.y2 - door.box.y1));
+        box["status"] = Json::Value(door.status);
+        if (transition)
+            box["previous_status"] = Json::Value(door.previous);
+        box["confidence"] = Json::Value(door.box.score);
+        if (door.box.track_id > 0)
+            box["track_id"] = Json::Value(door.box.track_id);
+        return box;
+    };
+
+    Json::Value root;
+    root["camera_idx"] = Json::Value(camera_idx);
+    root["timeStamp"] = Json::Value(timeStamp);
+    root["event"] = Json::Value(events.heartbeat ? "heartbeat" : "transition");
+    root["transitions"] = Json::arrayValue;
+    for (size_t i = 0; i < events.transitions.size(); i++)
+        root["transitions"].append(door_json(events.transitions[i], true));
+    if (events.heartbeat)
+    {
+        root["doors"] = Json::arrayValue;
+        for (size_t i = 0; i < events.doors.size(); i++)
+            root["doors"].append(door_json(events.doors[i], false));
+    }
+    root["anyDoorOpen"] = Json::Value(events.any_door_open);
+
+    ofstream os;
+    if (append)
+        os.open(filePath, std::ios::app);
+    else
+        os.open(filePath, std::ios::binary);
+    if (!os.is_open())
+        printf("Error: can not find or create the file which named : %s \n", filePath);
+    string dataStr = root.toStyledString();
+    os << dataStr;
+    os.close();
+    return dataStr;
+}
+
+// fill the profile from one entry of "execution_profiles", the missing keys keep their defaults
+void parseExecutionProfile(const Json::Value& json_profile, ExecutionProfile& profile)
+{
+    if (json_profile.isMember("num_threads"))
+        profile.num_threads = json_profile["num_threads"].asInt();
+    if (json_profile.isMember("cpu_cores"))
+    {
+        string cores = json_profile["cpu_cores"].asString();
+        if (cores == "little")
+            profile.cpu_cores = 1;
+        else if (cores == "big")
+            profile.cpu_cores = 2;
+        else
+            profile.cpu_cores = 0;
+    }
+    if (json_profile.isMember("powersave"))
+        profile.powersave = json_profile["powersave"].asBool();
+    if (json_profile.isMember("light_mode"))
+        profile.light_mode = json_profile["light_mode"].asBool();
+    if (json_profile.isMember("use_packing_layout"))
+        profile.use_packing_layout = json_profile["use_packing_layout"].asBool();
+    if (json_profile.isMember("use_fp16_packed"))
+        profile.use_fp16_packed = json_profile["use_fp16_packed"].asBool();
+    if (json_profile.isMember("use_fp16_storage"))
+        profile.use_fp16_storage = json_profile["use_fp16_storage"].asBool();
+    if (json_profile.isMember("use_fp16_arithmetic"))
+        profile.use_fp16_arithmetic = json_profile["use_fp16_arithmetic"].asBool();
+    if (json_profile.isMember("use_bf16_storage"))
+        profile.use_bf16_storage = json_profile["use_bf16_storage"].asBool();
+}
+
+// "drop_oldest", "drop_newest" or "block", anything else keeps the given policy
+QueueFullPolicy parseQueuePolicy(const string& name, QueueFullPolicy policy)
+{
+    if (name == "drop_oldest")
+        return QUEUE_DROP_OLDEST;
+    if (name == "drop_newest")
+        return QUEUE_DROP_NEWEST;
+    if (name == "block")
+        return QUEUE_BLOCK;
+    if (!name.empty())
+        printf("warning: unknown queue policy %s \n", name.c_str());
+    return policy;
+}
+
+void parseQueueConfig(const Json::Value& json_queue, QueueConfig& queue)
+{
+    if (json_queue.isMember("size"))
+        queue.capacity = json_queue["size"].asInt();
+    if (json_queue.isMember("policy"))
+        queue.policy = parseQueuePolicy(json_queue["policy"].asString(), queue.policy);
+}
+
+const char* queuePolicyName(QueueFullPolicy policy)
+{
+    return policy == QUEUE_DROP_OLDEST ? "drop_oldest" : policy == QUEUE_DROP_NEWEST ? "drop_newest" : "block";
+}
+
 bool parseConfig(const char* filename, DoorDet_config& config)
 {
     std::ifstream ifs;
@@ -211,6 +618,12 @@ bool parseConfig(const char* filename, DoorDet_config& config)
     // start parsing
     float det_threshold = json_obj["det_threshold"].asFloat();
     config.det_threshold = det_threshold;
+    const Json::Value& input_size = json_obj["input_size"];
+    if (input_size.isObject())
+    {
+        config.input_size[0] = input_size.get("height", config.input_size[0]).asInt();
+        config.input_size[1] = input_size.get("width", config.input_size[1]).asInt();
+    }
     int compute_every_frames = json_obj["compute_every_frames"].asInt();
     config.compute_every_frames = compute_every_frames;
     bool sync_results_frame = json_obj["sync_results_frame"].asBool();
@@ -219,98 +632,219 @@ bool parseConfig(const char* filename, DoorDet_config& config)
     config.sharedMemID = shared_memory_key;
     int shared_sem_key = json_obj["shared_sem_key"].asInt();
     config.sharedSemID = shared_sem_key;
-    bool sync_waiting_sharedMemory_consumed = json_obj["sync_waiting_sharedMemory_consumed"].asBool();
-    config.sync_waiting_sharedMemory_consumed = sync_waiting_sharedMemory_consumed;
+    config.sharedMemTransport = json_obj.get("shared_memory_transport", config.sharedMemTransport).asString();
+    config.sharedMemName = json_obj.get("shared_memory_name", config.sharedMemName).asString();
+    config.sharedMemSlots = std::max(json_obj.get("shared_memory_slots", config.sharedMemSlots).asInt(), 1);
+    config.sharedMemSlotSize = std::max(json_obj.get("shared_memory_slot_size", config.sharedMemSlotSize).asInt(), 1);
+    config.sharedMemFormat = json_obj.get("shared_memory_format", config.sharedMemFormat).asString();
+    // the fp32 model unless the quantized pair is asked for, see tools/int8_calibration
+    config.model_precision = json_obj.get("model_precision", config.model_precision).asString();
+    config.model_param = json_obj.get("model_param", config.model_param).asString();
+    config.model_bin = json_obj.get("model_bin", config.model_bin).asString();
+    if (config.model_precision == "int8")
+    {
+        string int8_param = json_obj.get("int8_model_param", "").asString();
+        string int8_bin = json_obj.get("int8_model_bin", "").asString();
+        if (int8_param.empty() || int8_bin.empty())
+        {
+            // the detector would run on an unloaded net, the fp32 model is kept instead
+            printf("error: model_precision int8 needs int8_model_param and int8_model_bin, using the fp32 model \n");
+            config.model_precision = "fp32";
+        } else
+        {
+            config.model_param = int8_param;
+            config.model_bin = int8_bin;
+        }
+    }
+    config.execution_profile_name = json_obj["execution_profile"].asString();
+    const Json::Value& profiles = json_obj["execution_profiles"];
+    if (!config.execution_profile_name.empty())
+    {
+        if (profiles.isObject() && profiles.isMember(config.execution_profile_name))
+            parseExecutionProfile(profiles[config.execution_profile_name], config.execution_profile);
+        else
+            printf("warning: execution profile %s not found, the defaults are used \n", config.execution_profile_name.c_str());
+    }
+    const Json::Value& pipeline = json_obj["pipeline"];
+    if (pipeline.isObject())
+    {
+        parseQueueConfig(pipeline["capture_queue"], config.capture_queue);
+        parseQueueConfig(pipeline["result_queue"], config.result_queue);
+        config.latest_frame_capture = pipeline.get("capture_mode", "queue").asString() == "latest_frame";
+    }
+    const Json::Value& motion_gate = json_obj["motion_gate"];
+    if (motion_gate.isObject())
+    {
+        MotionGateConfig& gate = config.motion_gate;
+        gate.enabled = motion_gate.get("enabled", gate.enabled).asBool();
+        gate.width = motion_gate.get("width", gate.width).asInt();
+        gate.pixel_threshold = motion_gate.get("pixel_threshold", gate.pixel_threshold).asInt();
+        gate.threshold = motion_gate.get("threshold", gate.threshold).asFloat();
+        gate.background_rate = motion_gate.get("background_rate", gate.background_rate).asFloat();
+        gate.min_interval_ms = motion_gate.get("min_interval_ms", gate.min_interval_ms).asInt();
+        gate.max_idle_ms = motion_gate.get("max_idle_ms", gate.max_idle_ms).asInt();
+    }
+    config.capture_backend = json_obj.get("capture_backend", config.capture_backend).asString();
+    const Json::Value& v4l2 = json_obj["v4l2"];
+    if (v4l2.isObject())
+    {
+        V4l2CameraConfig& stream = config.v4l2;
+        stream.width = v4l2.get("width", stream.width).asInt();
+        stream.height = v4l2.get("height", stream.height).asInt();
+        stream.pixel_format = v4l2.get("pixel_format", stream.pixel_format).asString();
+        stream.fps = v4l2.get("fps", stream.fps).asInt();
+        stream.buffers = v4l2.get("buffers", stream.buffers).asInt();
+        stream.loop = v4l2.get("loop", stream.loop).asBool();
+    }
+    config.camera_deadline_ms = json_obj.get("camera_deadline_ms", config.camera_deadline_ms).asInt();
+    config.inference_workers = json_obj.get("inference_workers", config.inference_workers).asInt();
+    config.tile_workers = json_obj.get("tile_workers", config.tile_workers).asInt();
+    const Json::Value& tracker = json_obj["tracker"];
+    if (tracker.isObject())
+    {
+        config.tracker.enabled = tracker.get("enabled", config.tracker.enabled).asBool();
+        config.tracker.iou_threshold = tracker.get("iou_threshold", config.tracker.iou_threshold).asFloat();
+        config.tracker.max_age_ms = tracker.get("max_age_ms", config.tracker.max_age_ms).asInt();
+        config.tracker.process_noise = tracker.get("process_noise", config.tracker.process_noise).asFloat();
+        config.tracker.measurement_noise = tracker.get("measurement_noise", config.tracker.measurement_noise).asFloat();
+    }
+    const Json::Value& flow = json_obj["flow"];
+    if (flow.isObject())
+    {
+        config.flow.enabled = flow.get("enabled", config.flow.enabled).asBool();
+        config.flow.width = flow.get("width", config.flow.width).asInt();
+        config.flow.max_corners = flow.get("max_corners", config.flow.max_corners).asInt();
+        config.flow.window = flow.get("window", config.flow.window).asInt();
+        config.flow.levels = flow.get("levels", config.flow.levels).asInt();
+        config.flow.max_shift = flow.get("max_shift", config.flow.max_shift).asFloat();
+        config.flow.max_scale = flow.get("max_scale", config.flow.max_scale).asFloat();
+        config.flow.min_tracked = flow.get("min_tracked", config.flow.min_tracked).asFloat();
+    }
+    const Json::Value& door_events = json_obj["door_events"];
+    if (door_events.isObject())
+    {
+        DoorEventConfig& events = config.door_events;
+        events.enabled = door_events.get("enabled", events.enabled).asBool();
+        events.confirm_frames = door_events.get("confirm_frames", events.confirm_frames).asInt();
+        events.confidence_margin = door_events.get("confidence_margin", events.confidence_margin).asFloat();
+        events.lost_frames = door_events.get("lost_frames", events.lost_frames).asInt();
+        events.iou_threshold = door_events.get("iou_threshold", events.iou_threshold).asFloat();
+        events.heartbeat_ms = door_events.get("heartbeat_ms", events.heartbeat_ms).asInt();
+    }
+    const Json::Value& frame_bus = json_obj["frame_bus"];
+    if (frame_bus.isObject())
+    {
+        FrameBusConfig& bus = config.frame_bus;
+        bus.enabled = frame_bus.get("enabled", bus.enabled).asBool();
+        bus.name = frame_bus.get("name", bus.name).asString();
+        bus.slots = std::max(frame_bus.get("slots", bus.slots).asInt(), 1);
+        bus.max_width = std::max(frame_bus.get("max_width", bus.max_width).asInt(), 1);
+        bus.max_height = std::max(frame_bus.get("max_height", bus.max_height).asInt(), 1);
+        bus.annotated = frame_bus.get("annotated", bus.annotated).asBool();
+        bus.hold_ms = frame_bus.get("hold_ms", bus.hold_ms).asInt();
+    }
+    const Json::Value& cameras = json_obj["cameras"];
+    for (Json::ArrayIndex i = 0; cameras.isArray() && i < cameras.size(); i++)
+    {
+        CameraConfig camera;
+        camera.id = cameras[i]["id"].asInt();
+        camera.deadline_ms = cameras[i].get("deadline_ms", config.camera_deadline_ms).asInt();
+        camera.device = cameras[i].get("device", "").asString();
+        const Json::Value& roi = cameras[i]["roi"];
+        if (roi.isObject())
+            camera.roi = cv::Rect(roi["x"].asInt(), roi["y"].asInt(), roi["width"].asInt(), roi["height"].asInt());
+        const Json::Value& tiles = cameras[i]["tiles"];
+        if (tiles.isObject())
+        {
+            camera.tiles.cols = tiles.get("cols", camera.tiles.cols).asInt();
+            camera.tiles.rows = tiles.get("rows", camera.tiles.rows).asInt();
+            camera.tiles.overlap = tiles.get("overlap", camera.tiles.overlap).asFloat();
+        }
+        config.cameras.push_back(camera);
+    }
 
 
     // check the configs
     printf("parsed Configs STARTED\n");
     printf("det_threshold:%.2f\n", config.det_threshold);
+    printf("input_size:%dx%d (width x height)\n", config.input_size[1], config.input_size[0]);
     printf("compute_every_frames:%d\n", config.compute_every_frames);
+    const MotionGateConfig& gate = config.motion_gate;
+    printf("motion_gate:%s (width:%d pixel_threshold:%d threshold:%.3f background_rate:%.3f min_interval_ms:%d max_idle_ms:%d)\n",
+           gate.enabled ? "true" : "false", gate.width, gate.pixel_threshold, gate.threshold, gate.background_rate,
+           gate.min_interval_ms, gate.max_idle_ms);
+    const TrackerConfig& tracker_config = config.tracker;
+    printf("tracker:%s (iou_threshold:%.2f max_age_ms:%d process_noise:%.1f measurement_noise:%.1f)\n",
+           tracker_config.enabled ? "true" : "false", tracker_config.iou_threshold, tracker_config.max_age_ms,
+           tracker_config.process_noise, tracker_config.measurement_noise);
+    const FlowConfig& flow_config = config.flow;
+    printf("flow:%s (width:%d max_corners:%d window:%d levels:%d max_shift:%.2f max_scale:%.2f min_tracked:%.2f)\n",
+           flow_config.enabled ? "true" : "false", flow_config.width, flow_config.max_corners, flow_config.window,
+           flow_config.levels, flow_config.max_shift, flow_config.max_scale, flow_config.min_tracked);
+    const DoorEventConfig& events_config = config.door_events;
+    printf("door_events:%s (confirm_frames:%d confidence_margin:%.2f lost_frames:%d iou_threshold:%.2f heartbeat_ms:%d)\n",
+           events_config.enabled ? "true" : "false", events_config.confirm_frames, events_config.confidence_margin,
+           events_config.lost_frames, events_config.iou_threshold, events_config.heartbeat_ms);
+    const FrameBusConfig& bus_config = config.frame_bus;
+    printf("frame_bus:%s (name:%s slots:%d max:%dx%d annotated:%s hold_ms:%d)\n", bus_config.enabled ? "true" : "false",
+           bus_config.name.c_str(), bus_config.slots, bus_config.max_width, bus_config.max_height,
+           bus_config.annotated ? "true" : "false", bus_config.hold_ms);
     printf("sync_results_frame:%s\n", config.sync_results_frame ? "true" : "false");
     printf("sharedMemID:%d\n", config.sharedMemID);
     printf("sharedSemID:%d\n", config.sharedSemID);
-    printf("sync_waiting_sharedMemory_consumed:%s\n", config.sync_waiting_sharedMemory_consumed ? "true" : "false");
+    printf("sharedMemTransport:%s sharedMemName:%s\n", config.sharedMemTransport.c_str(), config.sharedMemName.c_str());
+    printf("sharedMemSlots:%d sharedMemSlotSize:%d sharedMemFormat:%s\n", config.sharedMemSlots, config.sharedMemSlotSize, config.sharedMemFormat.c_str());
+    printf("model_precision:%s (%s, %s)\n", config.model_precision.c_str(), config.model_param.c_str(), config.model_bin.c_str());
+    const ExecutionProfile& profile = config.execution_profile;
+    printf("execution_profile:%s (threads:%d cores:%d powersave:%s light_mode:%s packing:%s fp16 packed/storage/arithmetic:%s/%s/%s bf16_storage:%s)\n",
+           config.execution_profile_name.empty() ? "default" : config.execution_profile_name.c_str(),
+           profile.num_threads, profile.cpu_cores, profile.powersave ? "true" : "false", profile.light_mode ? "true" : "false",
+           profile.use_packing_layout ? "true" : "false", profile.use_fp16_packed ? "true" : "false",
+           profile.use_fp16_storage ? "true" : "false", profile.use_fp16_arithmetic ? "true" : "false",
+           profile.use_bf16_storage ? "true" : "false");
+    printf("pipeline capture_mode:%s capture_queue:%d %s result_queue:%d %s\n", config.latest_frame_capture ? "latest_frame" : "queue",
+           config.capture_queue.capacity, queuePolicyName(config.capture_queue.policy),
+           config.result_queue.capacity, queuePolicyName(config.result_queue.policy));
+    printf("capture_backend:%s (v4l2 %dx%d %s %dfps buffers:%d loop:%s)\n", config.capture_backend.c_str(), config.v4l2.width, config.v4l2.height,
+           config.v4l2.pixel_format.c_str(), config.v4l2.fps, config.v4l2.buffers, config.v4l2.loop ? "true" : "false");
+    printf("inference_workers:%d tile_workers:%d camera_deadline_ms:%d cameras:", config.inference_workers, config.tile_workers, config.camera_deadline_ms);
+    for (size_t i = 0; i < config.cameras.size(); i++)
+    {
+        const CameraConfig& camera = config.cameras[i];
+        printf(" %d(%dms%s%s", camera.id, camera.deadline_ms, camera.device.empty() ? "" : " ", camera.device.c_str());
+        if (camera.roi.area() > 0)
+            printf(" roi:%d,%d %dx%d", camera.roi.x, camera.roi.y, camera.roi.width, camera.roi.height);
+        if (camera.tiles.enabled())
+            printf(" tiles:%dx%d overlap:%.2f", camera.tiles.cols, camera.tiles.rows, camera.tiles.overlap);
+        printf(")");
+    }
+    printf("\n");
     printf("parsed Configs ENDED\n");
 
     return true;
 
 }
 
-int resize_uniform(cv::Mat& src, cv::Mat& dst, cv::Size dst_size, object_rect& effect_area)
-{
-    int w = src.cols;
-    int h = src.rows;
-    int dst_w = dst_size.width;
-    int dst_h = dst_size.height;
-    //std::cout << "src: (" << h << ", " << w << ")" << std::endl;
-    dst = cv::Mat(cv::Size(dst_w, dst_h), CV_8UC3, cv::Scalar(0));
-
-    float ratio_src = w * 1.0 / h;
-    float ratio_dst = dst_w * 1.0 / dst_h;
-
-    int tmp_w = 0;
-    int tmp_h = 0;
-    if (ratio_src > ratio_dst) {
-        tmp_w = dst_w;
-        tmp_h = floor((dst_w * 1.0 / w) * h);
-    }
-    else if (ratio_src < ratio_dst) {
-        tmp_h = dst_h;
-        tmp_w = floor((dst_h * 1.0 / h) * w);
-    }
-    else {
-        cv::resize(cv::InputArray(src), cv::OutputArray(dst), dst_size);
-        effect_area.x = 0;
-        effect_area.y = 0;
-        effect_area.width = dst_w;
-        effect_area.height = dst_h;
-        return 0;
-    }
-
-    //std::cout << "tmp: (" << tmp_h << ", " << tmp_w << ")" << std::endl;
-    cv::Mat tmp;
-    cv::resize(cv::InputArray(src), cv::OutputArray(tmp), cv::Size(tmp_w, tmp_h));
-
-    if (tmp_w != dst_w) {
-        int index_w = floor((dst_w - tmp_w) / 2.0);
-        //std::cout << "index_w: " << index_w << std::endl;
-        for (int i = 0; i < dst_h; i++) {
-            memcpy(dst.data + i * dst_w * 3 + index_w * 3, tmp.data + i * tmp_w * 3, tmp_w * 3);
-        }
-        effect_area.x = index_w;
-        effect_area.y = 0;
-        effect_area.width = tmp_w;
-        effect_area.height = tmp_h;
-    }
-    else if (tmp_h != dst_h) {
-        int index_h = floor((dst_h - tmp_h) / 2.0);
-        //std::cout << "index_h: " << index_h << std::endl;
-        memcpy(dst.data + index_h * dst_w * 3, tmp.data, tmp_w * tmp_h * 3);
-        effect_area.x = 0;
-        effect_area.y = index_h;
-        effect_area.width = tmp_w;
-        effect_area.height = tmp_h;
-    }
-    else {
-        printf("error\n");
-    }
-    //cv::imshow("dst", dst);
-    //cv::waitKey(0);
-    return 0;
-}
-
 const int color_list[2][3] =
 {
     {216 , 82 , 24},
     {0 ,0 , 255}
 };
 
-void draw_bboxes(const cv::Mat& bgr, DoorDet_config config, const std::vector<BoxInfo>& bboxes, object_rect effect_roi, char* winName, int camera_id, bool savingLogs, char* logPath, uint64_t timeStamp, bool append)
+void draw_bboxes(const cv::Mat& bgr, const DoorDet_config& config, const std::vector<BoxInfo>& bboxes, object_rect effect_roi, char* winName, int camera_id, bool savingLogs, char* logPath, uint64_t timeStamp, bool append, cv::Mat* canvas)
 {
     static const char* class_names[] = {"box_close", "box_open"};
 
-    cv::Mat image = bgr.clone();
+    // drawn into the canvas when there is one (a frame bus slot), in place of the copy of the frame
+    cv::Mat image;
+    if (canvas != nullptr && !canvas->empty())
+    {
+        bgr.copyTo(*canvas);
+        image = *canvas;
+    } else
+    {
+        image = bgr.clone();
+    }
     int src_w = image.cols;
     int src_h = image.rows;
     int dst_w = effect_roi.width;
@@ -343,6 +877,7 @@ void draw_bboxes(const cv::Mat& bgr, DoorDet_config config, const std::vector<Bo
         DoorDetResultInfo doorInfo;
         doorInfo.label = bbox.label;
         doorInfo.conf = bbox.score;
+        doorInfo.track_id = bbox.track_id;
         doorInfo.boundingBox.x = obj_rect.x;
         doorInfo.boundingBox.y = obj_rect.y;
         doorInfo.boundingBox.width = obj_rect.width;
@@ -350,7 +885,10 @@ void draw_bboxes(const cv::Mat& bgr, DoorDet_config config, const std::vector<Bo
         results.doorInfoArray.push_back(doorInfo);
 
         char text[256];
-        sprintf(text, "%s %.1f%%", class_names[bbox.label], bbox.score * 100);
+        if (bbox.track_id > 0)
+            sprintf(text, "#%d %s %.1f%%", bbox.track_id, class_names[bbox.label], bbox.score * 100);
+        else
+            sprintf(text, "%s %.1f%%", class_names[bbox.label], bbox.score * 100);
 
         int baseLine = 0;
         cv::Size label_size = cv::getTextSize(text, cv::FONT_HERSHEY_SIMPLEX, 0.4, 1, &baseLine);
@@ -400,153 +938,471 @@ void draw_bboxes(const cv::Mat& bgr, DoorDet_config config, const std::vector<Bo
     if (!savingLogs) return;
     // construct the log path
     string result = WriteFileJson(logPath, results, true);
-    writeToSharedMemory(result, config);
+    writeToSharedMemory(config.sharedMemFormat == "json" ? result : EncodeResultRecord(results), config);
 }
 
 
-// dual cameras mode
-int webcam_demo(NanoDet& detector, DoorDet_config config, int cam_id_1, int cam_id_2)
+// with door_events enabled the logs and the shared memory get the status changes of the doors of the
+// packet's camera instead of its boxes, see DoorEventEngine; the frames without a change publish nothing
+void publish_door_events(DoorEventEngine& engine, const DoorDet_config& config, const FramePacket& packet, char* logPath)
 {
-    cv::Mat image1, image2;
-    cv::VideoCapture cap1(cam_id_1), cap2(cam_id_2);
-    int height = detector.input_size[0];
-    int width = detector.input_size[1];
-    if (!cap1.isOpened())
+    DoorEvents events;
+    if (!engine.update(packet.results, packet.computed, packet.timeStamp, events))
+        return;
+    string result = WriteEventJson(logPath, packet.camera_idx, packet.timeStamp, events, true);
+    writeToSharedMemory(config.sharedMemFormat == "json" ? result : EncodeEventRecord(packet.camera_idx, packet.timeStamp, events), config);
+}
+
+// draws the packet as draw_bboxes does and, with the frame bus on, publishes its frame there: the
+// annotated frame is drawn straight into the bus slot, the captured one is copied in once.
+// detections is the detection count of the packet's camera so far
+void draw_packet(const DoorDet_config& config, const FramePacket& packet, uint64_t detections, char* winName, char* logPath)
+{
+    int slot = -1;
+    cv::Mat canvas = beginBusFrame(config.frame_bus, packet, slot);
+    if (slot >= 0 && !config.frame_bus.annotated)
+        packet.image.copyTo(canvas);
+    draw_bboxes(packet.image, config, packet.results, packet.effect_roi, winName, packet.camera_idx, !config.door_events.enabled,
+                logPath, packet.timeStamp, true, config.frame_bus.annotated ? &canvas : nullptr);
+    if (slot >= 0)
+        commitBusFrame(slot, packet, detections, config.frame_bus.annotated);
+}
+
+// the whole frame as the area the boxes of its packet are relative to, for draw_bboxes
+object_rect frame_area(const FramePacket& packet)
+{
+    object_rect area = {0, 0, packet.width(), packet.height()};
+    return area;
+}
+
+// detects on the roi of the camera (the whole frame if empty) and moves the boxes to the coordinates
+// of the frame, so the results of any camera can be drawn over the whole frame, see frame_area.
+// A tiled camera has its roi split into overlapping tiles run concurrently on tile_pool, whose boxes
+// are merged across the seams. YUV driver buffers go to the detector as they are, the BGR frame is
+// only made for the display
+std::vector<BoxInfo> detect_packet(NanoDet& detector, const DoorDet_config& config, FramePacket& packet, const CameraConfig& camera, TilePool* tile_pool)
+{
+    YuvLayout layout;
+    const bool yuv = packet.image.empty() && raw_frame_yuv_layout(packet.raw, layout);
+    if (!yuv && packet.image.empty())
     {
-        printf("failed to open camera %d", cam_id_1);
-        return -1;
+        raw_frame_to_bgr(packet.raw, packet.image);
+        packet.raw = RawFrame();
+        // a corrupt MJPG buffer, the caller drops the packet (it has no size left)
+        if (packet.image.empty())
+            return std::vector<BoxInfo>();
     }
+    const cv::Rect area = clip_crop(camera.roi, packet.width(), packet.height(), yuv);
+    packet.effect_roi = frame_area(packet);
+
+    // the boxes of one crop of the frame, in frame coordinates
+    auto detect_crop = [&](const cv::Rect& crop, DetectionWorkspace* workspace) {
+        std::vector<BoxInfo> boxes;
+        object_rect letterbox;
+        if (yuv && workspace)
+            boxes = detector.detect_frame(packet.raw.data, layout, crop, config.det_threshold, NMS_THRESHOLD, letterbox, *workspace);
+        else if (yuv)
+            boxes = detector.detect_frame(packet.raw.data, layout, crop, config.det_threshold, NMS_THRESHOLD, letterbox);
+        else if (workspace)
+            boxes = detector.detect_frame(packet.image(crop), config.det_threshold, NMS_THRESHOLD, letterbox, *workspace);
+        else
+            boxes = detector.detect_frame(packet.image(crop), config.det_threshold, NMS_THRESHOLD, letterbox);
+        letterbox_boxes_to_frame(boxes, letterbox, crop);
+        return boxes;
+    };
+
+    if (!camera.tiles.enabled() || tile_pool == nullptr)
+        return detect_crop(area, nullptr);
+
+    const std::vector<cv::Rect> tiles = tile_grid(area, camera.tiles, yuv);
+    std::vector<std::vector<BoxInfo> > tile_boxes(tiles.size());
+    tile_pool->run((int)tiles.size(), [&](int tile, DetectionWorkspace& workspace) {
+        tile_boxes[tile] = detect_crop(tiles[tile], &workspace);
+    });
+    std::vector<BoxInfo> boxes;
+    for (size_t t = 0; t < tile_boxes.size(); t++)
+        boxes.insert(boxes.end(), tile_boxes[t].begin(), tile_boxes[t].end());
+    return merge_tile_boxes(boxes, config.det_threshold, NMS_THRESHOLD);
+}
 
-    if (!cap2.isOpened())
+// multi-camera mode: a capture thread per camera, frames due for detection go through the scheduler
+// to a pool of inference workers, the others are published with the last results of their camera,
+// moved by the optical flow or predicted by the tracker when enabled; a motion too large for the flow
+// has the frame detected. A skipped frame is published right away unless a frame of its camera is
+// still in detection, then it waits in the scheduler behind it: every camera publishes in capture
+// order, and its tracker is predicted and updated in that order. Drawing, logging and the shared memory writes of all the cameras
+// happen on the calling thread.
+// With the v4l2 backend a single capture thread serves every camera through one epoll loop, and the
+// frames travel as driver buffers: YUV frames are detected as they are and converted to BGR by the
+// publish stage (MJPG ones are decoded by the worker), the buffer going back to the driver as soon
+// as the BGR image exists.
+int multi_camera_demo(NanoDet& detector, const DoorDet_config& config, const vector<CameraConfig>& cameras, TilePool* tile_pool)
+{
+    const int num_cameras = (int)cameras.size();
+    const bool use_v4l2 = config.capture_backend == "v4l2";
+
+    vector<std::unique_ptr<cv::VideoCapture> > caps(num_cameras);
+    V4l2Capture v4l2;
+    vector<int> deadlines_ms(num_cameras);
+    vector<string> winNames(num_cameras);
+    for (int i = 0; i < num_cameras; i++)
     {
-        printf("failed to open camera %d", cam_id_2);
-        return -1;
+        if (use_v4l2)
+        {
+            V4l2CameraConfig stream = config.v4l2;
+            stream.device = cameras[i].device.empty() ? "/dev/video" + std::to_string(cameras[i].id) : cameras[i].device;
+            if (v4l2.add_device(stream) != i)
+            {
+                printf("failed to open camera %d\n", cameras[i].id);
+                return -1;
+            }
+        } else
+        {
+            caps[i].reset(new cv::VideoCapture(cameras[i].id));
+            if (!caps[i]->isOpened())
+            {
+                printf("failed to open camera %d\n", cameras[i].id);
+                return -1;
+            }
+        }
+        deadlines_ms[i] = cameras[i].deadline_ms;
+        winNames[i] = "WIN_" + std::to_string(cameras[i].id);
     }
 
-    char* winName1 = new char[10]();
-    sprintf(winName1, "WIN_%d", cam_id_1);
-
-    char* winName2 = new char[10]();
-    sprintf(winName2, "WIN_%d", cam_id_2);
-
     std::time_t result = std::time(nullptr);
     char* logPath = new char[100]();
     sprintf(logPath, "./log_%d.txt", result);
 
-    int64_t frameIndex = -1;
-    std::vector<BoxInfo> results_cam1, results_cam2;
-    while (true)
-    {
-        // the flag whether the abnormal status detected
-        bool isAnyDoorOpen = false;
+    CameraScheduler scheduler(deadlines_ms, config.capture_queue);
+    BoundedQueue<FramePacket> detected(config.result_queue.capacity, config.result_queue.policy);
+
+    // hands one captured frame of camera i to the scheduler or, when skipped with no frame of its camera
+    // ahead, straight to the publisher
+    vector<DetectionGate> gates(num_cameras, DetectionGate(config.compute_every_frames, config.motion_gate));
+    vector<std::unique_ptr<BoxTracker> > trackers;
+    for (int i = 0; i < num_cameras; i++)
+        trackers.push_back(std::unique_ptr<BoxTracker>(new BoxTracker(config.tracker)));
+    vector<std::unique_ptr<BoxFlow> > flows;
+    for (int i = 0; i < num_cameras; i++)
+        flows.push_back(std::unique_ptr<BoxFlow>(new BoxFlow(config.flow)));
+    // the results of a skipped frame: moved by the flow, predicted by the tracker or the last ones of
+    // its camera. Called once the frames of the camera before it are handed on
+    auto carry_over = [&](int i, FramePacket& packet) {
+        packet.camera_slot = i;
+        packet.effect_roi = frame_area(packet);
+        // the flow boxes are already in the packet
+        if (config.flow.enabled)
+            return;
+        if (config.tracker.enabled)
+            packet.results = trackers[i]->predict(packet.timeStamp);
+        else
+            packet.results = scheduler.latest_results(i);
+    };
+    auto dispatch = [&](int i, FramePacket& packet) {
+        packet.camera_idx = cameras[i].id;
+        packet.timeStamp = duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        const cv::Mat view = packet.image.empty() ? raw_frame_motion_view(packet.raw) : packet.image;
+        // a corrupt or partial MJPG buffer, common with USB cameras, decodes to nothing: the frame is dropped
+        if (view.empty())
+            return;
+        // a motion too large for the flow to follow brings the detection of the frame forward
+        std::vector<BoxInfo> flow_boxes;
+        packet.computed = gates[i].should_detect(view, packet.timeStamp)
+                          || (config.flow.enabled && !flows[i]->propagate(view, packet.width(), flow_boxes));
+        if (!packet.computed && config.sync_results_frame)
+            return;
+        if (!packet.computed)
+            packet.results = flow_boxes;
+        // a skipped frame waits behind the detection of its camera in flight, if any, so the frames of
+        // a camera are published in capture order
+        if (!scheduler.submit(i, packet))
+        {
+            carry_over(i, packet);
+            detected.push(packet);
+        }
+    };
 
-        cap1 >> image1;
+    vector<std::thread> capture_stages;
+    if (use_v4l2)
+    {
+        capture_stages.push_back(std::thread([&]() {
+            vector<RawFrame> frames;
+            while (v4l2.wait_frames(frames, 1000))
+            {
+                for (size_t f = 0; f < frames.size(); f++)
+                {
+                    FramePacket packet;
+                    packet.raw = frames[f];
+                    dispatch(frames[f].source, packet);
+                }
+            }
+            for (int i = 0; i < num_cameras; i++)
+                scheduler.close_camera(i);
+        }));
+    }
+    for (int i = 0; i < num_cameras && !use_v4l2; i++)
+    {
+        capture_stages.push_back(std::thread([&, i]() {
+            while (true)
+            {
+                FramePacket packet;
+                *caps[i] >> packet.image;
+                if (packet.image.empty())
+                    break;
+                dispatch(i, packet);
+            }
+            scheduler.close_camera(i);
+        }));
+    }
 
-        frameIndex++;
-        if (frameIndex > 10000)
-            frameIndex = 0;
+    vector<std::thread> infer_stages;
+    for (int w = 0; w < std::max(config.inference_workers, 1); w++)
+    {
+        infer_stages.push_back(std::thread([&]() {
+            FramePacket packet;
+            while (scheduler.next(packet))
+            {
+                const int camera_slot = packet.camera_slot;
+                if (!packet.computed)
+                {
+                    carry_over(camera_slot, packet);
+                    detected.push(packet);
+                    scheduler.done(camera_slot);
+                    continue;
+                }
+                // the same view of the frame the dispatch gives the flow, taken before the detection decodes MJPG
+                cv::Mat view;
+                if (config.flow.enabled)
+                    view = packet.image.empty() ? raw_frame_motion_view(packet.raw) : packet.image;
+                packet.results = detect_packet(detector, config, packet, cameras[packet.camera_slot], tile_pool);
+                // the MJPG buffer decoded to nothing, nothing to publish
+                if (packet.width() == 0)
+                {
+                    scheduler.done(camera_slot);
+                    continue;
+                }
+                if (config.tracker.enabled)
+                    packet.results = trackers[camera_slot]->update(packet.results, packet.timeStamp);
+                if (config.flow.enabled)
+                    flows[camera_slot]->reset(view, packet.width(), packet.results);
+                scheduler.set_latest_results(camera_slot, packet.results);
+                detected.push(packet);
+                scheduler.done(camera_slot);
+            }
+            detector.release_thread_workspace();
+        }));
+    }
 
-        object_rect effect_roi;
-        cv::Mat resized_img;
-        resize_uniform(image1, resized_img, cv::Size(width, height), effect_roi);
-        if (frameIndex % config.compute_every_frames == 0)
-        {
-            results_cam1.clear();
-            results_cam1 = detector.detect(resized_img, config.det_threshold, NMS_THRESHOLD);
-        } else
+    // the publish loop ends once every producer of the result queue is done
+    std::thread closer([&]() {
+        for (size_t i = 0; i < capture_stages.size(); i++)
+            capture_stages[i].join();
+        for (size_t w = 0; w < infer_stages.size(); w++)
+            infer_stages[w].join();
+        detected.close();
+    });
+
+    vector<bool> doorOpen(num_cameras, false);
+    vector<DoorEventEngine> door_events(num_cameras, DoorEventEngine(config.door_events, config.det_threshold));
+    vector<uint64_t> detections(num_cameras, 0);
+    uint64_t published = 0;
+    FramePacket packet;
+    while (detected.pop(packet))
+    {
+        const int i = packet.camera_slot;
+        if (packet.image.empty())
         {
-            if (config.sync_results_frame)
+            raw_frame_to_bgr(packet.raw, packet.image);
+            packet.raw = RawFrame();
+            if (packet.image.empty())
                 continue;
         }
+        if (packet.computed)
+            detections[i]++;
+        draw_packet(config, packet, detections[i], &winNames[i][0], logPath);
+        if (config.door_events.enabled)
+            publish_door_events(door_events[i], config, packet, logPath);
+        cv::waitKey(1);
 
-        uint64_t timeStamp_ms = duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-
-        draw_bboxes(image1, config, results_cam1, effect_roi, winName1, cam_id_1, true, logPath, timeStamp_ms, true);
-
-        for (auto box : results_cam1)
+        doorOpen[i] = false;
+        for (auto box : packet.results)
         {
             if (box.label > 0)
-            {
-                isAnyDoorOpen = true;
-            }
+                doorOpen[i] = true;
+        }
+        // the summarized info
+        if (std::find(doorOpen.begin(), doorOpen.end(), true) != doorOpen.end())
+        {
+            printf("WARNING: detected open door via the %d-ways-camera!!\n", num_cameras);
         }
-        cv::waitKey(1);
 
-        cap2 >> image2;
-        resize_uniform(image2, resized_img, cv::Size(width, height), effect_roi);
-        if (frameIndex % config.compute_every_frames == 0)
+        if (++published % 300 == 0)
         {
-            results_cam2.clear();
-            results_cam2 = detector.detect(resized_img, config.det_threshold, NMS_THRESHOLD);
+            for (int c = 0; c < num_cameras; c++)
+                printf("camera %d: deadline misses:%llu dropped frames:%llu\n", cameras[c].id,
+                       (unsigned long long)scheduler.deadline_misses(c), (unsigned long long)scheduler.dropped_frames(c));
         }
+    }
+
+    closer.join();
+    delete[] logPath;
+    return 0;
+}
 
-        draw_bboxes(image2, config, results_cam2, effect_roi, winName2, cam_id_2, true, logPath, timeStamp_ms, true);
+// capture -> infer -> publish, each stage on its own thread handing frames forward through a bounded
+// queue, so the frame rate follows the slowest stage instead of the sum of all of them. The publish
+// stage (drawing, JSON log, shared memory write) runs on the calling thread which owns the windows.
+// With latest_frame the capture thread keeps grabbing while the detector runs and the detector always
+// takes the newest frame from a triple buffer, the frames it did not get to are overwritten instead of
+// queued, so the driver buffers never pile up behind a slow detection. Not for video files, whose
+// frames would be skipped; nor is a capture_queue which drops, video_demo makes it block. Returns once
+// the capture runs out of frames.
+int pipeline_demo(NanoDet& detector, const DoorDet_config& config, cv::VideoCapture& cap, const CameraConfig& camera, TilePool* tile_pool, char* winName, char* logPath, bool printStats, bool latest_frame)
+{
+    BoundedQueue<FramePacket> captured(config.capture_queue.capacity, config.capture_queue.policy);
+    LatestFrameBuffer<FramePacket> latest;
+    BoundedQueue<FramePacket> detected(config.result_queue.capacity, config.result_queue.policy);
 
-        for (auto box : results_cam2)
+    std::thread capture_stage([&]() {
+        if (latest_frame)
         {
-            if (box.label > 0)
+            while (!latest.is_closed())
             {
-                isAnyDoorOpen = true;
+                FramePacket& packet = latest.write_slot();
+                // the slot may hold a frame still drawn downstream, cap >> would overwrite its pixels in place
+                if (packet.image.u && packet.image.u->refcount > 1)
+                    packet.image.release();
+                cap >> packet.image;
+                if (packet.image.empty())
+                    break;
+                packet.camera_idx = camera.id;
+                packet.camera_slot = 0;
+                packet.timeStamp = duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                latest.publish();
             }
+            latest.close();
+            return;
         }
-
-        cv::waitKey(1);
-
-        // the summarized info
-        if (isAnyDoorOpen)
+        while (!captured.is_closed())
         {
-            printf("WARNING: detected open door via the 2-ways-camera!!\n");
+            FramePacket packet;
+            cap >> packet.image;
+            if (packet.image.empty())
+                break;
+            packet.camera_idx = camera.id;
+            packet.camera_slot = 0;
+            packet.timeStamp = duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            captured.push(packet);
         }
+        captured.close();
+    });
+
+    std::thread infer_stage([&]() {
+        std::vector<BoxInfo> results;
+        DetectionGate gate(config.compute_every_frames, config.motion_gate);
+        BoxTracker tracker(config.tracker);
+        BoxFlow flow(config.flow);
+        uint64_t flow_detections = 0;
+        int frameIndex = -1;
+        // how old the frames are when the detector takes them, the latency the capture adds
+        uint64_t capture_age_sum_ms = 0;
+        uint64_t capture_age_frames = 0;
+        FramePacket packet;
+        while (latest_frame ? latest.take(packet) : captured.pop(packet))
+        {
+            frameIndex++;
+            if (frameIndex > 10000)
+                frameIndex = 0;
+            uint64_t now_ms = duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            uint64_t capture_age_ms = now_ms > packet.timeStamp ? now_ms - packet.timeStamp : 0;
+            capture_age_sum_ms += capture_age_ms;
+            capture_age_frames++;
+            // the results are in frame coordinates, the skipped frames reuse them as they are, as the tracker
+            // predicts them or as the flow moves them
+            packet.effect_roi = frame_area(packet);
+            packet.computed = gate.should_detect(packet.image, packet.timeStamp);
+            std::vector<BoxInfo> flow_boxes;
+            // a motion too large for the flow to follow brings the detection of the frame forward
+            if (!packet.computed && config.flow.enabled && !flow.propagate(packet.image, packet.image.cols, flow_boxes))
+            {
+                packet.computed = true;
+                flow_detections++;
+            }
+            if (packet.computed)
+            {
+                results = detect_packet(detector, config, packet, camera, tile_pool);
+                if (config.tracker.enabled)
+                    results = tracker.update(results, packet.timeStamp);
+                if (config.flow.enabled)
+                    flow.reset(packet.image, packet.image.cols, results);
+                if (printStats)
+                {
+                    AllocationStats blob_stats = detector.blob_allocation_stats();
+                    AllocationStats workspace_stats = detector.workspace_allocation_stats();
+                    uint64_t capture_drops = latest_frame ? latest.overwritten_count() : captured.dropped_count();
+                    printf("this frame %d is computed (change score %.3f, capture age %llums, avg %.1fms), pool buffers blob:%llu/%llu workspace:%llu/%llu (new/requests), drops capture:%llu result:%llu, brought forward by the flow:%llu\n",
+                           frameIndex, gate.score(), (unsigned long long)capture_age_ms, (double)capture_age_sum_ms / capture_age_frames,
+                           (unsigned long long)blob_stats.new_buffers, (unsigned long long)blob_stats.requests,
+                           (unsigned long long)workspace_stats.new_buffers, (unsigned long long)workspace_stats.requests,
+                           (unsigned long long)capture_drops, (unsigned long long)detected.dropped_count(),
+                           (unsigned long long)flow_detections);
+                }
+            } else
+            {
+                if (config.sync_results_frame)
+                    continue;
+                if (config.flow.enabled)
+                    results = flow_boxes;
+                // the last boxes moved to where the tracks are expected at this frame
+                else if (config.tracker.enabled)
+                    results = tracker.predict(packet.timeStamp);
+            }
+            packet.results = results;
+            if (!detected.push(packet) && detected.is_closed())
+                break;
+        }
+        detector.release_thread_workspace();
+        // the capture stage stops on its next frame when the publish side is gone
+        captured.close();
+        latest.close();
+        detected.close();
+    });
+
+    DoorEventEngine door_events(config.door_events, config.det_threshold);
+    uint64_t detections = 0;
+    FramePacket packet;
+    while (detected.pop(packet))
+    {
+        if (packet.computed)
+            detections++;
+        draw_packet(config, packet, detections, winName, logPath);
+        if (config.door_events.enabled)
+            publish_door_events(door_events, config, packet, logPath);
+        cv::waitKey(1);
     }
-    delete[] winName1;
-    delete[] winName2;
-    delete[] logPath;
+
+    infer_stage.join();
+    capture_stage.join();
     return 0;
 }
 
 // single camera mode
-int webcam_demo(NanoDet& detector, DoorDet_config config, int cam_id)
+int webcam_demo(NanoDet& detector, const DoorDet_config& config, const CameraConfig& camera, TilePool* tile_pool)
 {
-    cv::Mat image;
-    cv::VideoCapture cap(cam_id);
-    int height = detector.input_size[0];
-    int width = detector.input_size[1];
+    cv::VideoCapture cap(camera.id);
     if (!cap.isOpened())
     {
-        printf("failed to open camera %d\n", cam_id);
+        printf("failed to open camera %d\n", camera.id);
         return -1;
     }
     std::time_t result = std::time(nullptr);
     char* logPath = new char[100]();
     sprintf(logPath, "./log_%d.txt", result);
     char* winName = new char[10]();
-    sprintf(winName, "WIN_%d", cam_id);
+    sprintf(winName, "WIN_%d", camera.id);
 
-    std::vector<BoxInfo> results;
-    int frameIndex = -1;
-    while (true)
-    {
-        cap >> image;
-        frameIndex++;
-        if (frameIndex > 10000)
-            frameIndex = 0;
-        object_rect effect_roi;
-        cv::Mat resized_img;
-        resize_uniform(image, resized_img, cv::Size(width, height), effect_roi);
+    pipeline_demo(detector, config, cap, camera, tile_pool, winName, logPath, true, config.latest_frame_capture);
 
-        if (frameIndex % config.compute_every_frames == 0 || frameIndex < 0)
-        {
-            printf("this frame %d is computed\n", frameIndex);
-            results = detector.detect(resized_img, config.det_threshold, NMS_THRESHOLD);
-        } else
-        {
-            if (config.sync_results_frame)
-                continue;
-        }
-        uint64_t timeStamp_ms = duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-        draw_bboxes(image, config, results, effect_roi, winName, cam_id, true, logPath, timeStamp_ms, true);
-        cv::waitKey(1);
-    }
     delete[] winName;
     delete[] logPath;
     return 0;
@@ -554,12 +1410,9 @@ int webcam_demo(NanoDet& detector, DoorDet_config config, int cam_id)
 
 
 
-int video_demo(NanoDet& detector, const DoorDet_config config, const char* path)
+int video_demo(NanoDet& detector, const DoorDet_config& config, const char* path)
 {
-    cv::Mat image;
     cv::VideoCapture cap(path);
-    int height = detector.input_size[0];
-    int width = detector.input_size[1];
 
     std::time_t result = std::time(nullptr);
 
@@ -567,48 +1420,29 @@ int video_demo(NanoDet& detector, const DoorDet_config config, const char* path)
     sprintf(logPath, "./log_%d.txt", result);
 
     printf("config.thresh:%.2f\n", config.det_threshold);
-    std::vector<BoxInfo> results;
-    int frameIndex = -1;
-    while (true)
-    {
-        cap >> image;
-
-        frameIndex++;
-        if (frameIndex > 10000)
-            frameIndex = 0;
-
-        object_rect effect_roi;
-        cv::Mat resized_img;
-        resize_uniform(image, resized_img, cv::Size(width, height), effect_roi);
+    char winName[] = "video";
+    CameraConfig camera;
+    camera.id = 0;
+    camera.deadline_ms = config.camera_deadline_ms;
+    // a file decodes faster than the detector runs, with the drop policy of the cameras most of its
+    // frames would never be detected; the capture waits for the detector instead
+    DoorDet_config video_config = config;
+    video_config.capture_queue.policy = QUEUE_BLOCK;
+    pipeline_demo(detector, video_config, cap, camera, nullptr, winName, logPath, false, false);
 
-        if (frameIndex % config.compute_every_frames == 0)
-        {
-            results = detector.detect(resized_img, config.det_threshold, NMS_THRESHOLD);
-        } else
-        {
-            if (config.sync_results_frame)
-                continue;
-        }
-
-        uint64_t timeStamp_ms = duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-
-        draw_bboxes(image, config, results, effect_roi, "video", 0, true, logPath, timeStamp_ms, true);
-        cv::waitKey(1);
-    }
-       delete[] logPath;
+    delete[] logPath;
     return 0;
 }
 
 
 int main(int argc, char** argv)
 {
-   if (argc != 3 && argc != 4)
+   if (argc < 2 || (argc < 3 && atoi(argv[1]) != 0))
    {
-       fprintf(stderr, "usage: %s [mode] [path]. \n For webcam mode=0, path is cam ids (single cam: e.g. 0, dual cams: e.g. 0 2); \n For video, mode=1 path=video.mp4.\n", argv[0]);
+       fprintf(stderr, "usage: %s [mode] [path]. \n For webcam mode=0, path is cam ids (single cam: e.g. 0, several cams: e.g. 0 2 4, none: the cameras of config.json); \n For video, mode=1 path=video.mp4.\n", argv[0]);
        return -1;
    }
 
-   NanoDet detector = NanoDet("/home/teamhd/opencvTest_QT/ncnn_models/nanodet_door.param", "/home/teamhd/opencvTest_QT/ncnn_models/nanodet_door.bin", true);
    int mode = atoi(argv[1]);
 
    DoorDet_config config;
@@ -621,21 +1455,55 @@ int main(int argc, char** argv)
        printf("warning : config parsing failed! \n");
    }
 
+   // the execution profile has to be known before the model is loaded
+   NanoDet detector(config.model_param.c_str(), config.model_bin.c_str(), true, config.execution_profile);
+   detector.input_size[0] = config.input_size[0];
+   detector.input_size[1] = config.input_size[1];
+   detector.update_center_priors();
+
    initSharedMemory(config);
 
    switch (mode)
    {
      case 0:
      {
-        if (argc == 3)
+        // the camera ids of the command line take precedence over the ones of config.json, whose
+        // settings (deadline, device, roi) still apply to the cameras listed there
+        vector<CameraConfig> cameras;
+        for (int i = 2; i < argc; i++)
         {
-          int cam_id = atoi(argv[2]);
-          webcam_demo(detector, config, cam_id);
-        } else if (argc == 4)
+            CameraConfig camera;
+            camera.id = atoi(argv[i]);
+            camera.deadline_ms = config.camera_deadline_ms;
+            for (size_t c = 0; c < config.cameras.size(); c++)
+            {
+                if (config.cameras[c].id == camera.id)
+                    camera = config.cameras[c];
+            }
+            cameras.push_back(camera);
+        }
+        if (cameras.empty())
+            cameras = config.cameras;
+        initFrameBus(config.frame_bus, (int)cameras.size());
+
+        // one pool runs the tiles of every tiled camera
+        std::unique_ptr<TilePool> tile_pool;
+        for (size_t i = 0; i < cameras.size(); i++)
         {
-           int cam_id_1 = atoi(argv[2]);
-           int cam_id_2 = atoi(argv[3]);
-           webcam_demo(detector, config, cam_id_1, cam_id_2);
+            if (cameras[i].tiles.enabled() && !tile_pool)
+                tile_pool.reset(new TilePool(config.tile_workers));
+        }
+
+        // the v4l2 backend always runs the scheduler, its epoll loop serves any number of cameras
+        if (cameras.size() == 1 && config.capture_backend != "v4l2")
+        {
+          webcam_demo(detector, config, cameras[0], tile_pool.get());
+        } else if (!cameras.empty())
+        {
+           multi_camera_demo(detector, config, cameras, tile_pool.get());
+        } else
+        {
+           fprintf(stderr, "no camera given on the command line nor in config.json\n");
         }
         break;
      }
@@ -643,18 +1511,20 @@ int main(int argc, char** argv)
      case 1:
      {
         const char* path = argv[2];
+        initFrameBus(config.frame_bus, 1);
         video_demo(detector, config, path);
         break;
      }
 
      default:
      {
-         fprintf(stderr, "usage: %s [mode] [path]. \n For webcam mode=0, path is cam ids (single cam: e.g. 0, dual cams: e.g. 0 2); \n For video, mode=1 path=video.mp4.\n", argv[0]);
+         fprintf(stderr, "usage: %s [mode] [path]. \n For webcam mode=0, path is cam ids (single cam: e.g. 0, several cams: e.g. 0 2 4, none: the cameras of config.json); \n For video, mode=1 path=video.mp4.\n", argv[0]);
          break;
      }
    }
 
    releaseSharedMemory();
+   releaseFrameBus();
    return 0;
 }
 
@@ -664,8 +1534,6 @@ int main(int argc, char** argv)
 
 int main_()
 {
-    NanoDet detector = NanoDet("/home/teamhd/opencvTest_QT/ncnn_models/nanodet_door.param", "/home/teamhd/opencvTest_QT/ncnn_models/nanodet_door.bin", true);
-
     DoorDet_config config;
     bool ret = parseConfig("./config.json", config);
     if (ret)
@@ -676,13 +1544,20 @@ int main_()
         printf("warning : config parsing failed! \n");
     }
 
+    NanoDet detector(config.model_param.c_str(), config.model_bin.c_str(), true, config.execution_profile);
+
     initSharedMemory(config);
+    initFrameBus(config.frame_bus, 1);
 
-    webcam_demo(detector, config, 0);
+    CameraConfig camera;
+    camera.id = 0;
+    camera.deadline_ms = config.camera_deadline_ms;
+    webcam_demo(detector, config, camera, nullptr);
 
     //video_demo(detector, "/home/teamhd/Downloads/video_09_02_230317_nightOpen_reserved_TEST.mp4");
 
     releaseSharedMemory();
+    releaseFrameBus();
     return 0;
 }
 
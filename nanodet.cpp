@@ -4,10 +4,15 @@
 //
 
 #include "nanodet.h"
+#include "nanodet_kernels.h"
 #include <benchmark.h>
+#include <cpu.h>
 // #include <iostream>
 
-float cal_iou(BoxInfo box1, BoxInfo box2) {
+// label of the boxes that win a cross-class overlap, an open door is never hidden by a closed one
+#define OPEN_LABEL 1
+
+float cal_iou(const BoxInfo& box1, const BoxInfo& box2) {
     float ratio = 0.f;
     auto box1_w = box1.x2 - box1.x1;
     auto box1_h = box1.y2 - box1.y1;
@@ -36,86 +41,85 @@ float cal_iou(BoxInfo box1, BoxInfo box2) {
 }
 
 
-std::vector<BoxInfo> mergeDecision(std::vector<BoxInfo> detections, float score_thresh, float nms_thresh) {
+// resolve the overlaps between boxes of different classes: every box which is not open and overlaps
+// a box of another class by IoU >= overlap_thresh is dropped, so "open" wins over "close".
+// The pairs are found with a sweep over the boxes sorted by x1: a box only has to be compared with
+// the following boxes starting left of its right edge, which is near-linear for the usual sparse frames.
+// The result keeps the boxes above score_thresh in descending score order.
+std::vector<BoxInfo> mergeDecision(const std::vector<BoxInfo>& detections, float score_thresh, float overlap_thresh) {
     std::vector<BoxInfo> all_box;
-    for (auto &box: detections) {
-        auto score = box.score;
-        if (score > score_thresh) {
-            BoxInfo tmpBox = BoxInfo();
-            tmpBox.x1 = box.x1;
-            tmpBox.y1 = box.y1;
-            tmpBox.x2 = box.x2;
-            tmpBox.y2 = box.y2;
-            tmpBox.label = box.label;
-            tmpBox.score = box.score;
-            all_box.push_back(tmpBox);
+    all_box.reserve(detections.size());
+    for (const auto& box: detections) {
+        if (box.score > score_thresh) {
+            all_box.push_back(box);
         }
     }
 
-    sort(all_box.begin(), all_box.end(), [](const BoxInfo &lhs, const BoxInfo &rhs) {
+    stable_sort(all_box.begin(), all_box.end(), [](const BoxInfo &lhs, const BoxInfo &rhs) {
         return lhs.score > rhs.score;
     });
 
-    std::vector<BoxInfo> refinedBoxes;
-    int index_of_box_a = 0;
-    for (auto box_a: all_box) {
-        for (auto box_b: all_box) {
-            auto iou = cal_iou(box_a, box_b);
-            if (box_a.label != box_b.label && iou >= nms_thresh) {
-                printf("merging performed !!!!!! overlapping detected \n");
-                if (box_a.label != 1) {
-                    all_box[index_of_box_a].label = -1;
-                }
+    const int num_boxes = (int)all_box.size();
+    std::vector<int> by_x1(num_boxes);
+    for (int i = 0; i < num_boxes; i++) {
+        by_x1[i] = i;
+    }
+    sort(by_x1.begin(), by_x1.end(), [&all_box](int lhs, int rhs) {
+        return all_box[lhs].x1 < all_box[rhs].x1;
+    });
+
+    std::vector<char> dropped(num_boxes, 0);
+    for (int a = 0; a < num_boxes; a++) {
+        const BoxInfo& box_a = all_box[by_x1[a]];
+        for (int b = a + 1; b < num_boxes; b++) {
+            const BoxInfo& box_b = all_box[by_x1[b]];
+            // with a positive threshold only intersecting boxes can conflict, and every later box
+            // starts at or right of box_b, so nothing further on can intersect box_a anymore
+            if (overlap_thresh > 0 && box_b.x1 >= box_a.x2) {
+                break;
+            }
+            if (box_a.label == box_b.label || !(cal_iou(box_a, box_b) >= overlap_thresh)) {
+                continue;
+            }
+            if (box_a.label != OPEN_LABEL) {
+                dropped[by_x1[a]] = 1;
+            }
+            if (box_b.label != OPEN_LABEL) {
+                dropped[by_x1[b]] = 1;
             }
         }
-        index_of_box_a++;
     }
 
     // check all the item
-    for (auto item: all_box) {
-        if (item.label != -1) {
-            refinedBoxes.push_back(item);
+    std::vector<BoxInfo> refinedBoxes;
+    for (int i = 0; i < num_boxes; i++) {
+        if (!dropped[i]) {
+            refinedBoxes.push_back(all_box[i]);
         }
     }
     return refinedBoxes;
 }
 
-inline float fast_exp(float x)
-{
-    union {
-        uint32_t i;
-        float f;
-    } v{};
-    v.i = (1 << 23) * (1.4426950409 * x + 126.93490512f);
-    return v.f;
-}
-
 inline float sigmoid(float x)
 {
     return 1.0f / (1.0f + fast_exp(-x));
 }
 
-template<typename _Tp>
-int activation_function_softmax(const _Tp* src, _Tp* dst, int length)
+static void generate_grid_center_priors(const int input_height, const int input_width, const std::vector<int>& strides, CenterPriors& center_priors)
 {
-    const _Tp alpha = *std::max_element(src, src + length);
-    _Tp denominator{ 0 };
-
-    for (int i = 0; i < length; ++i) {
-        dst[i] = fast_exp(src[i] - alpha);
-        denominator += dst[i];
-    }
-
-    for (int i = 0; i < length; ++i) {
-        dst[i] /= denominator;
+    int num_points = 0;
+    for (int i = 0; i < (int)strides.size(); i++)
+    {
+        num_points += (int)ceil((float)input_width / strides[i]) * (int)ceil((float)input_height / strides[i]);
     }
 
-    return 0;
-}
-
+    center_priors.x.resize(num_points);
+    center_priors.y.resize(num_points);
+    center_priors.stride.resize(num_points);
+    center_priors.ct_x.resize(num_points);
+    center_priors.ct_y.resize(num_points);
 
-static void generate_grid_center_priors(const int input_height, const int input_width, std::vector<int>& strides, std::vector<CenterPrior>& center_priors)
-{
+    int idx = 0;
     for (int i = 0; i < (int)strides.size(); i++)
     {
         int stride = strides[i];
@@ -125,182 +129,285 @@ static void generate_grid_center_priors(const int input_height, const int input_
         {
             for (int x = 0; x < feat_w; x++)
             {
-                CenterPrior ct;
-                ct.x = x;
-                ct.y = y;
-                ct.stride = stride;
-                center_priors.push_back(ct);
+                center_priors.x[idx] = x;
+                center_priors.y[idx] = y;
+                center_priors.stride[idx] = stride;
+                center_priors.ct_x[idx] = (float)(x * stride);
+                center_priors.ct_y[idx] = (float)(y * stride);
+                idx++;
             }
         }
     }
 }
 
 
-bool NanoDet::hasGPU = false;
-NanoDet* NanoDet::detector = nullptr;
+// the normalization the model was trained with, BGR order
+static const float mean_vals[3] = { 103.53f, 116.28f, 123.675f };
+static const float norm_vals[3] = { 0.017429f, 0.017507f, 0.017125f };
 
-NanoDet::NanoDet(const char* param, const char* bin, bool useGPU)
+static bool vulkan_available()
 {
-    this->Net = new ncnn::Net();
-    // opt
 #if NCNN_VULKAN
-    this->hasGPU = ncnn::get_gpu_count() > 0;
+    return ncnn::get_gpu_count() > 0;
+#else
+    return false;
 #endif
-    this->Net->opt.use_vulkan_compute = this->hasGPU && useGPU;
-    this->Net->opt.use_fp16_arithmetic = true;
+}
+
+NanoDet::NanoDet(const char* param, const char* bin, bool useGPU, const ExecutionProfile& profile)
+    : hasGPU(useGPU && vulkan_available())
+{
+    this->Net = new ncnn::Net();
+    this->profile = profile;
+    // opt, the storage/packing flags must be set before the model is loaded
+    this->Net->opt.use_vulkan_compute = this->hasGPU;
+    this->Net->opt.num_threads = this->profile_num_threads();
+    this->Net->opt.lightmode = profile.light_mode;
+    this->Net->opt.openmp_blocktime = profile.powersave ? 0 : 20;
+    this->Net->opt.use_packing_layout = profile.use_packing_layout;
+    this->Net->opt.use_fp16_packed = profile.use_fp16_packed;
+    this->Net->opt.use_fp16_storage = profile.use_fp16_storage;
+    this->Net->opt.use_fp16_arithmetic = profile.use_fp16_arithmetic;
+    this->Net->opt.use_bf16_storage = profile.use_bf16_storage;
     this->Net->load_param(param);
     this->Net->load_model(bin);
+
+    this->update_center_priors();
 }
 
 NanoDet::~NanoDet()
 {
+    for (auto& item : this->workspaces)
+        delete item.second;
     delete this->Net;
 }
 
-void NanoDet::preprocess(cv::Mat& image, ncnn::Mat& in)
+DetectionWorkspace& NanoDet::thread_workspace()
+{
+    std::lock_guard<std::mutex> lock(this->workspaces_lock);
+    DetectionWorkspace*& workspace = this->workspaces[std::this_thread::get_id()];
+    if (workspace == nullptr)
+        workspace = new DetectionWorkspace();
+    return *workspace;
+}
+
+void NanoDet::release_thread_workspace()
+{
+    DetectionWorkspace* workspace = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(this->workspaces_lock);
+        auto item = this->workspaces.find(std::this_thread::get_id());
+        if (item == this->workspaces.end())
+            return;
+        workspace = item->second;
+        this->workspaces.erase(item);
+    }
+    delete workspace;
+}
+
+AllocationStats NanoDet::blob_allocation_stats()
+{
+    std::lock_guard<std::mutex> lock(this->workspaces_lock);
+    AllocationStats total = {0, 0};
+    for (auto& item : this->workspaces)
+    {
+        AllocationStats stats = item.second->context.blob_stats();
+        total.requests += stats.requests;
+        total.new_buffers += stats.new_buffers;
+    }
+    return total;
+}
+
+AllocationStats NanoDet::workspace_allocation_stats()
+{
+    std::lock_guard<std::mutex> lock(this->workspaces_lock);
+    AllocationStats total = {0, 0};
+    for (auto& item : this->workspaces)
+    {
+        AllocationStats stats = item.second->context.workspace_stats();
+        total.requests += stats.requests;
+        total.new_buffers += stats.new_buffers;
+    }
+    return total;
+}
+
+std::shared_ptr<const CenterPriors> NanoDet::update_center_priors()
+{
+    std::lock_guard<std::mutex> lock(this->priors_lock);
+    if (this->center_priors && this->prior_input_size[0] == this->input_size[0] && this->prior_input_size[1] == this->input_size[1]
+        && this->prior_strides == this->strides)
+        return this->center_priors;
+
+    std::shared_ptr<CenterPriors> priors = std::make_shared<CenterPriors>();
+    generate_grid_center_priors(this->input_size[0], this->input_size[1], this->strides, *priors);
+    this->center_priors = priors;
+    this->prior_input_size[0] = this->input_size[0];
+    this->prior_input_size[1] = this->input_size[1];
+    this->prior_strides = this->strides;
+    return this->center_priors;
+}
+
+int NanoDet::profile_num_threads() const
+{
+    if (this->profile.num_threads > 0)
+        return this->profile.num_threads;
+
+    int cores = ncnn::get_cpu_count();
+    if (this->profile.cpu_cores == 1 && ncnn::get_little_cpu_count() > 0)
+        cores = ncnn::get_little_cpu_count();
+    else if (this->profile.cpu_cores == 2 && ncnn::get_big_cpu_count() > 0)
+        cores = ncnn::get_big_cpu_count();
+    return cores;
+}
+
+// the affinity mask is bound to the openmp team of the calling thread, so it is (re)applied the first
+// time a thread runs detect() and whenever the profile asks for another cluster
+void NanoDet::apply_thread_affinity() const
+{
+    static thread_local int applied_cpu_cores = -1;
+    if (applied_cpu_cores == this->profile.cpu_cores)
+        return;
+
+    // set_cpu_powersave writes the global cpu state of ncnn and is not thread-safe, the workers starting
+    // together take turns
+    static std::mutex powersave_lock;
+    std::lock_guard<std::mutex> lock(powersave_lock);
+    ncnn::set_cpu_powersave(this->profile.cpu_cores);
+    applied_cpu_cores = this->profile.cpu_cores;
+}
+
+void NanoDet::preprocess(cv::Mat& image, ncnn::Mat& in, ncnn::Allocator* allocator) const
 {
     int img_w = image.cols;
     int img_h = image.rows;
 
-    in = ncnn::Mat::from_pixels(image.data, ncnn::Mat::PIXEL_BGR, img_w, img_h);
+    // taken from the blob pool, so the input buffer is recycled from frame to frame
+    in = ncnn::Mat::from_pixels(image.data, ncnn::Mat::PIXEL_BGR, img_w, img_h, allocator);
     //in = ncnn::Mat::from_pixels_resize(image.data, ncnn::Mat::PIXEL_BGR, img_w, img_h, this->input_width, this->input_height);
 
-    const float mean_vals[3] = { 103.53f, 116.28f, 123.675f };
-    const float norm_vals[3] = { 0.017429f, 0.017507f, 0.017125f };
     in.substract_mean_normalize(mean_vals, norm_vals);
 }
 
 std::vector<BoxInfo> NanoDet::detect(cv::Mat image, float score_threshold, float nms_threshold)
 {
-    ncnn::Mat input;
-    preprocess(image, input);
+    return this->detect(image, score_threshold, nms_threshold, this->thread_workspace());
+}
+
+std::vector<BoxInfo> NanoDet::detect(cv::Mat image, float score_threshold, float nms_threshold, DetectionWorkspace& workspace)
+{
+    ncnn::Mat& input = workspace.context.input;
+    preprocess(image, input, &workspace.context.blob_pool_allocator);
+    return this->infer(input, score_threshold, nms_threshold, workspace);
+}
+
+std::vector<BoxInfo> NanoDet::detect_frame(const cv::Mat& frame, float score_threshold, float nms_threshold, object_rect& effect_area)
+{
+    return this->detect_frame(frame, score_threshold, nms_threshold, effect_area, this->thread_workspace());
+}
+
+std::vector<BoxInfo> NanoDet::detect_frame(const cv::Mat& frame, float score_threshold, float nms_threshold, object_rect& effect_area, DetectionWorkspace& workspace)
+{
+    ncnn::Mat& input = workspace.context.input;
+    letterbox_normalize(frame, this->input_size[1], this->input_size[0], mean_vals, norm_vals, input, effect_area, workspace.letterbox_taps, &workspace.context.blob_pool_allocator);
+    return this->infer(input, score_threshold, nms_threshold, workspace);
+}
+
+std::vector<BoxInfo> NanoDet::detect_frame(const cv::Mat& frame, YuvLayout layout, const cv::Rect& crop, float score_threshold, float nms_threshold, object_rect& effect_area)
+{
+    return this->detect_frame(frame, layout, crop, score_threshold, nms_threshold, effect_area, this->thread_workspace());
+}
+
+std::vector<BoxInfo> NanoDet::detect_frame(const cv::Mat& frame, YuvLayout layout, const cv::Rect& crop, float score_threshold, float nms_threshold, object_rect& effect_area, DetectionWorkspace& workspace)
+{
+    ncnn::Mat& input = workspace.context.input;
+    letterbox_normalize_yuv(frame, layout, crop, this->input_size[1], this->input_size[0], mean_vals, norm_vals, input, effect_area, workspace.letterbox_taps, &workspace.context.blob_pool_allocator);
+    return this->infer(input, score_threshold, nms_threshold, workspace);
+}
+
+std::vector<BoxInfo> NanoDet::infer(ncnn::Mat& input, float score_threshold, float nms_threshold, DetectionWorkspace& workspace)
+{
+    // center priors are cached, only rebuilt when input_size/strides were changed
+    std::shared_ptr<const CenterPriors> priors = this->update_center_priors();
 
     //double start = ncnn::get_current_time();
 
-    auto ex = this->Net->create_extractor();
-    ex.set_light_mode(false);
-    ex.set_num_threads(4);
+    this->apply_thread_affinity();
+
+    auto ex = workspace.context.create_extractor(this->Net);
+    ex.set_light_mode(this->profile.light_mode);
+    ex.set_num_threads(workspace.num_threads > 0 ? workspace.num_threads : this->profile_num_threads());
 #if NCNN_VULKAN
     ex.set_vulkan_compute(this->hasGPU);
 #endif
     ex.input("data", input);
 
-    std::vector<std::vector<BoxInfo>> results;
-    results.resize(this->num_class);
-
     ncnn::Mat out;
     ex.extract("output", out);
     // printf("%d %d %d \n", out.w, out.h, out.c);
 
-    // generate center priors in format of (x, y, stride)
-    std::vector<CenterPrior> center_priors;
-    generate_grid_center_priors(this->input_size[0], this->input_size[1], this->strides, center_priors);
-
-    this->decode_infer(out, center_priors, score_threshold, results);
+    this->decode_infer(out, *priors, score_threshold, workspace, workspace.candidates);
 
+    // per-class NMS of all the classes at once, grouped by class like the former per-class loop
     std::vector<BoxInfo> dets;
-    for (int i = 0; i < (int)results.size(); i++)
-    {
-        this->nms(results[i], nms_threshold);
-
-        for (auto box : results[i])
-        {
-            dets.push_back(box);
-        }
-    }
+    workspace.nms_engine.run_batched(workspace.candidates, nms_threshold, dets);
 
     std::vector<BoxInfo> refinedBoxes = mergeDecision(dets, score_threshold, 0.05f); // no interaction at all
     return refinedBoxes;
 }
 
-void NanoDet::decode_infer(ncnn::Mat& feats, std::vector<CenterPrior>& center_priors, float threshold, std::vector<std::vector<BoxInfo>>& results)
+void NanoDet::decode_infer(ncnn::Mat& feats, const CenterPriors& center_priors, float threshold, DetectionWorkspace& workspace, std::vector<BoxInfo>& results) const
 {
-    const int num_points = center_priors.size();
+    results.clear();
+    // never read past the output blob, even if the priors were built for another input size
+    const int num_points = (std::min)(center_priors.size(), feats.h);
+    const float* prior_ct_x = center_priors.ct_x.data();
+    const float* prior_ct_y = center_priors.ct_y.data();
+    const int* prior_stride = center_priors.stride.data();
     //printf("num_points:%d\n", num_points);
 
-    //cv::Mat debug_heatmap = cv::Mat(feature_h, feature_w, CV_8UC3);
-    for (int idx = 0; idx < num_points; idx++)
-    {
-        const int ct_x = center_priors[idx].x;
-        const int ct_y = center_priors[idx].y;
-        const int stride = center_priors[idx].stride;
+    // vectorized pass over the class scores of all the anchors, only the survivors are decoded
+    workspace.candidate_indices.resize(num_points);
+    int* candidates = workspace.candidate_indices.data();
+    const int num_candidates = scan_scores_above((const float*)feats.data, num_points, feats.w, this->num_class, threshold, candidates);
 
+    for (int i = 0; i < num_candidates; i++)
+    {
+        const int idx = candidates[i];
         const float* scores = feats.row(idx);
-        float score = 0;
         int cur_label = 0;
-        for (int label = 0; label < this->num_class; label++)
-        {
-            if (scores[label] > score)
-            {
-                score = scores[label];
-                cur_label = label;
-            }
-        }
-        if (score > threshold)
-        {
-            //std::cout << "label:" << cur_label << " score:" << score << std::endl;
-            const float* bbox_pred = feats.row(idx) + this->num_class;
-            results[cur_label].push_back(this->disPred2Bbox(bbox_pred, cur_label, score, ct_x, ct_y, stride));
-            //debug_heatmap.at<cv::Vec3b>(row, col)[0] = 255;
-            //cv::imshow("debug", debug_heatmap);
-        }
+        float score = row_max_score(scores, this->num_class, cur_label);
+
+        //std::cout << "label:" << cur_label << " score:" << score << std::endl;
+        const float* bbox_pred = feats.row(idx) + this->num_class;
+        results.push_back(this->disPred2Bbox(bbox_pred, cur_label, score, prior_ct_x[idx], prior_ct_y[idx], prior_stride[idx]));
     }
 }
 
-BoxInfo NanoDet::disPred2Bbox(const float*& dfl_det, int label, float score, int x, int y, int stride)
+BoxInfo NanoDet::disPred2Bbox(const float*& dfl_det, int label, float score, float ct_x, float ct_y, int stride) const
 {
-    float ct_x = x * stride;
-    float ct_y = y * stride;
-    std::vector<float> dis_pred;
-    dis_pred.resize(4);
-    for (int i = 0; i < 4; i++)
-    {
-        float dis = 0;
-        float* dis_after_sm = new float[this->reg_max + 1];
-        activation_function_softmax(dfl_det + i * (this->reg_max + 1), dis_after_sm, this->reg_max + 1);
-        for (int j = 0; j < this->reg_max + 1; j++)
-        {
-            dis += j * dis_after_sm[j];
-        }
-        dis *= stride;
-        //std::cout << "dis:" << dis << std::endl;
-        dis_pred[i] = dis;
-        delete[] dis_after_sm;
-    }
+    // left, top, right, bottom distances of all four sides decoded in one go, no heap traffic
+    float dis_pred[4];
+    dfl_decode_distances(dfl_det, this->reg_max, (float)stride, dis_pred);
+
     float xmin = (std::max)(ct_x - dis_pred[0], .0f);
     float ymin = (std::max)(ct_y - dis_pred[1], .0f);
-    float xmax = (std::min)(ct_x + dis_pred[2], (float)this->input_size[0]);
-    float ymax = (std::min)(ct_y + dis_pred[3], (float)this->input_size[1]);
+    // input_size is height, width
+    float xmax = (std::min)(ct_x + dis_pred[2], (float)this->input_size[1]);
+    float ymax = (std::min)(ct_y + dis_pred[3], (float)this->input_size[0]);
 
     //std::cout << xmin << "," << ymin << "," << xmax << "," << xmax << "," << std::endl;
     return BoxInfo { xmin, ymin, xmax, ymax, score, label };
 }
 
-void NanoDet::nms(std::vector<BoxInfo>& input_boxes, float NMS_THRESH)
+void letterbox_boxes_to_frame(std::vector<BoxInfo>& boxes, const object_rect& effect_area, const cv::Rect& crop)
 {
-    std::sort(input_boxes.begin(), input_boxes.end(), [](BoxInfo a, BoxInfo b) { return a.score > b.score; });
-    std::vector<float> vArea(input_boxes.size());
-    for (int i = 0; i < int(input_boxes.size()); ++i) {
-        vArea[i] = (input_boxes.at(i).x2 - input_boxes.at(i).x1 + 1)
-            * (input_boxes.at(i).y2 - input_boxes.at(i).y1 + 1);
-    }
-    for (int i = 0; i < int(input_boxes.size()); ++i) {
-        for (int j = i + 1; j < int(input_boxes.size());) {
-            float xx1 = (std::max)(input_boxes[i].x1, input_boxes[j].x1);
-            float yy1 = (std::max)(input_boxes[i].y1, input_boxes[j].y1);
-            float xx2 = (std::min)(input_boxes[i].x2, input_boxes[j].x2);
-            float yy2 = (std::min)(input_boxes[i].y2, input_boxes[j].y2);
-            float w = (std::max)(float(0), xx2 - xx1 + 1);
-            float h = (std::max)(float(0), yy2 - yy1 + 1);
-            float inter = w * h;
-            float ovr = inter / (vArea[i] + vArea[j] - inter);
-            if (ovr >= NMS_THRESH) {
-                input_boxes.erase(input_boxes.begin() + j);
-                vArea.erase(vArea.begin() + j);
-            }
-            else {
-                j++;
-            }
-        }
+    const float width_ratio = (float)crop.width / (float)effect_area.width;
+    const float height_ratio = (float)crop.height / (float)effect_area.height;
+    for (auto& box : boxes)
+    {
+        box.x1 = crop.x + (box.x1 - effect_area.x) * width_ratio;
+        box.y1 = crop.y + (box.y1 - effect_area.y) * height_ratio;
+        box.x2 = crop.x + (box.x2 - effect_area.x) * width_ratio;
+        box.y2 = crop.y + (box.y2 - effect_area.y) * height_ratio;
     }
 }
@@ -8,6 +8,13 @@
 
 #include <opencv2/core/core.hpp>
 #include <net.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "nms.h"
+#include "inference_context.h"
+#include "letterbox.h"
 
 typedef struct HeadInfo
 {
@@ -16,11 +23,16 @@ typedef struct HeadInfo
     int stride;
 };
 
-struct CenterPrior
+// center priors of all the feature levels, stored field by field so decode_infer walks them linearly
+struct CenterPriors
 {
-    int x;
-    int y;
-    int stride;
+    std::vector<int> x;
+    std::vector<int> y;
+    std::vector<int> stride;
+    std::vector<float> ct_x; // x * stride, the pixel center on the input
+    std::vector<float> ct_y; // y * stride
+
+    int size() const { return (int)stride.size(); }
 };
 
 typedef struct BoxInfo
@@ -31,34 +43,134 @@ typedef struct BoxInfo
     float y2;
     float score;
     int label;
+    int track_id; // the id of the door given by the BoxTracker, 0 when not tracked
 } BoxInfo;
 
+// how ncnn runs the network on this host, read from the "execution_profiles" of config.json
+struct ExecutionProfile
+{
+    int num_threads = 4; // 0 for as many threads as cores in the selected cluster
+    int cpu_cores = 0; // 0 = all cores, 1 = little cluster only, 2 = big cluster only (ncnn powersave modes)
+    bool powersave = false; // let the openmp threads sleep right after each layer instead of busy-waiting
+    bool light_mode = false; // recycle the intermediate blobs during the inference
+    bool use_packing_layout = true;
+    bool use_fp16_packed = true;
+    bool use_fp16_storage = true;
+    bool use_fp16_arithmetic = true;
+    bool use_bf16_storage = false;
+};
+
+// everything a detect() call writes to: the extractor pools and input mat, and the decode and NMS
+// scratch buffers. One workspace must only be used by one thread at a time, while any number of
+// workspaces can run detect() on the same NanoDet concurrently.
+class DetectionWorkspace
+{
+public:
+    DetectionWorkspace() {}
+
+    InferenceContext context;
+    // ncnn threads of the inferences run with this workspace, 0 for the num_threads of the profile
+    int num_threads = 0;
+    // indices of the anchors passing the score threshold, one slot per center prior
+    std::vector<int> candidate_indices;
+    // class-aware NMS over the candidates of all the classes in one pass
+    NmsEngine nms_engine;
+    std::vector<BoxInfo> candidates;
+    // letterbox taps of the last frame geometry, detect_frame only rebuilds them when it changes
+    LetterboxTaps letterbox_taps;
+
+private:
+    DetectionWorkspace(const DetectionWorkspace&);
+    DetectionWorkspace& operator=(const DetectionWorkspace&);
+};
+
+// The loaded network is shared and never modified after construction, ncnn runs several extractors
+// of one Net in parallel. detect() is safe to call from several threads: each calling thread gets its
+// own DetectionWorkspace, created on its first call and kept until the thread releases it or the
+// detector is destroyed. Threads which manage their workspace themselves can pass it explicitly and
+// skip the lookup.
 class NanoDet
 {
 public:
-    NanoDet(const char* param, const char* bin, bool useGPU);
+    NanoDet(const char* param, const char* bin, bool useGPU, const ExecutionProfile& profile = ExecutionProfile());
 
     ~NanoDet();
 
-    static NanoDet* detector;
-    ncnn::Net* Net;
-    static bool hasGPU;
+    // the vulkan device runs the network: one is present and the constructor was asked to use it
+    const bool hasGPU;
     // modify these parameters to the same with your config if you want to use your own model
     int input_size[2] = {416, 416}; // input height and width
     int num_class = 2; // number of classes. 80 for COCO
     int reg_max = 7; // `reg_max` set in the training config. Default: 7.
     std::vector<int> strides = { 8, 16, 32, 64 }; // strides of the multi-level feature.
 
+    ExecutionProfile profile;
+
     std::vector<BoxInfo> detect(cv::Mat image, float score_threshold, float nms_threshold);
+    std::vector<BoxInfo> detect(cv::Mat image, float score_threshold, float nms_threshold, DetectionWorkspace& workspace);
+
+    // detect on the full camera frame: letterboxing and normalization are done in one pass straight
+    // into the network input, effect_area is the same as resize_uniform would return
+    std::vector<BoxInfo> detect_frame(const cv::Mat& frame, float score_threshold, float nms_threshold, object_rect& effect_area);
+    std::vector<BoxInfo> detect_frame(const cv::Mat& frame, float score_threshold, float nms_threshold, object_rect& effect_area, DetectionWorkspace& workspace);
+
+    // detect on the crop of a YUV camera frame (see YuvLayout, the whole frame if crop is empty):
+    // resized in YUV space, only the network input is converted to BGR, boxes and effect_area are
+    // the same as for the BGR crop
+    std::vector<BoxInfo> detect_frame(const cv::Mat& frame, YuvLayout layout, const cv::Rect& crop, float score_threshold, float nms_threshold, object_rect& effect_area);
+    std::vector<BoxInfo> detect_frame(const cv::Mat& frame, YuvLayout layout, const cv::Rect& crop, float score_threshold, float nms_threshold, object_rect& effect_area, DetectionWorkspace& workspace);
+
+    // rebuild the cached center priors if input_size or strides changed since the last build. Calls in
+    // flight keep the priors they started with, input_size/strides themselves must not be written while
+    // another thread is detecting.
+    std::shared_ptr<const CenterPriors> update_center_priors();
+
+    // frees the workspace of the calling thread, for a thread which is done detecting and exits;
+    // otherwise the detector keeps one workspace per thread which ever detected until it is destroyed
+    void release_thread_workspace();
+
+    // allocation counters of the pools backing the extractors, summed over the workspaces of all the
+    // threads; new_buffers stays flat in the steady state
+    AllocationStats blob_allocation_stats();
+    AllocationStats workspace_allocation_stats();
+
+    // the loaded network, for the tools which inspect it (int8_calibration); not to be modified
+    const ncnn::Net& net() const { return *this->Net; }
 
     std::vector<std::string> labels{ "box_close", "box_open" };
+    // the letterboxed BGR image as the normalized network input, as fed by detect()
+    void preprocess(cv::Mat& image, ncnn::Mat& in, ncnn::Allocator* allocator = 0) const;
+
 private:
-    void preprocess(cv::Mat& image, ncnn::Mat& in);
-    void decode_infer(ncnn::Mat& feats, std::vector<CenterPrior>& center_priors, float threshold, std::vector<std::vector<BoxInfo>>& results);
-    BoxInfo disPred2Bbox(const float*& dfl_det, int label, float score, int x, int y, int stride);
-    static void nms(std::vector<BoxInfo>& result, float nms_threshold);
+    std::vector<BoxInfo> infer(ncnn::Mat& input, float score_threshold, float nms_threshold, DetectionWorkspace& workspace);
+    void decode_infer(ncnn::Mat& feats, const CenterPriors& center_priors, float threshold, DetectionWorkspace& workspace, std::vector<BoxInfo>& results) const;
+    BoxInfo disPred2Bbox(const float*& dfl_det, int label, float score, float ct_x, float ct_y, int stride) const;
+    void apply_thread_affinity() const;
+    int profile_num_threads() const;
+    DetectionWorkspace& thread_workspace();
+
+    ncnn::Net* Net;
+
+    // one workspace per thread calling detect() without its own
+    std::mutex workspaces_lock;
+    std::map<std::thread::id, DetectionWorkspace*> workspaces;
+
+    // built once per input_size/strides, shared read-only by every detect()
+    std::mutex priors_lock;
+    std::shared_ptr<const CenterPriors> center_priors;
+    int prior_input_size[2] = {0, 0};
+    std::vector<int> prior_strides;
 
 };
 
+float cal_iou(const BoxInfo& box1, const BoxInfo& box2);
+
+// drops every box which is not open and overlaps a box of another class by IoU >= overlap_thresh,
+// keeping the boxes above score_thresh in descending score order
+std::vector<BoxInfo> mergeDecision(const std::vector<BoxInfo>& detections, float score_thresh, float overlap_thresh);
+
+// boxes detected on the letterbox effect_area of the crop rectangle of a frame, moved to the pixel
+// coordinates of the whole frame
+void letterbox_boxes_to_frame(std::vector<BoxInfo>& boxes, const object_rect& effect_area, const cv::Rect& crop);
 
 #endif //NANODET_H
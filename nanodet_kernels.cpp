@@ -0,0 +1,262 @@
+#include "nanodet_kernels.h"
+#include <algorithm>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// fast_exp is only valid down to about -87, below that the bit trick wraps around
+#define FAST_EXP_MIN -87.f
+
+static void dfl_decode_distances_scalar(const float* dfl_det, int reg_max, float stride, float* dis_pred)
+{
+    const int num_bins = reg_max + 1;
+    for (int i = 0; i < 4; i++)
+    {
+        const float* logits = dfl_det + i * num_bins;
+        const float alpha = *std::max_element(logits, logits + num_bins);
+
+        // softmax expectation, sum(j * e^x_j) / sum(e^x_j), without storing the softmax itself
+        float denominator = 0.f;
+        float dis = 0.f;
+        for (int j = 0; j < num_bins; j++)
+        {
+            float e = fast_exp((std::max)(logits[j] - alpha, FAST_EXP_MIN));
+            denominator += e;
+            dis += j * e;
+        }
+        dis_pred[i] = dis / denominator * stride;
+    }
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+static inline __m256 fast_exp_avx2(__m256 x)
+{
+    x = _mm256_max_ps(x, _mm256_set1_ps(FAST_EXP_MIN));
+    __m256 t = _mm256_fmadd_ps(x, _mm256_set1_ps(1.4426950409f * (1 << 23)), _mm256_set1_ps(126.93490512f * (1 << 23)));
+    return _mm256_castsi256_ps(_mm256_cvttps_epi32(t));
+}
+
+// reg_max == 7: each side is 8 bins, one 256-bit row per side. The 4x8 block is transposed so that
+// lane k of c_j holds bin j (low half) or bin j + 4 (high half) of side k, so all four sides are
+// reduced side by side with vertical operations only.
+static void dfl_decode_distances_8(const float* dfl_det, float stride, float* dis_pred)
+{
+    __m256 r0 = _mm256_loadu_ps(dfl_det);
+    __m256 r1 = _mm256_loadu_ps(dfl_det + 8);
+    __m256 r2 = _mm256_loadu_ps(dfl_det + 16);
+    __m256 r3 = _mm256_loadu_ps(dfl_det + 24);
+
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 c0 = _mm256_shuffle_ps(t0, t2, 0x44);
+    __m256 c1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+    __m256 c2 = _mm256_shuffle_ps(t1, t3, 0x44);
+    __m256 c3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+
+    __m256 m = _mm256_max_ps(_mm256_max_ps(c0, c1), _mm256_max_ps(c2, c3));
+    __m128 m4 = _mm_max_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+    __m256 alpha = _mm256_set_m128(m4, m4);
+
+    __m256 e0 = fast_exp_avx2(_mm256_sub_ps(c0, alpha));
+    __m256 e1 = fast_exp_avx2(_mm256_sub_ps(c1, alpha));
+    __m256 e2 = fast_exp_avx2(_mm256_sub_ps(c2, alpha));
+    __m256 e3 = fast_exp_avx2(_mm256_sub_ps(c3, alpha));
+
+    __m256 sum = _mm256_add_ps(_mm256_add_ps(e0, e1), _mm256_add_ps(e2, e3));
+    __m256 wsum = _mm256_mul_ps(e0, _mm256_setr_ps(0, 0, 0, 0, 4, 4, 4, 4));
+    wsum = _mm256_fmadd_ps(e1, _mm256_setr_ps(1, 1, 1, 1, 5, 5, 5, 5), wsum);
+    wsum = _mm256_fmadd_ps(e2, _mm256_setr_ps(2, 2, 2, 2, 6, 6, 6, 6), wsum);
+    wsum = _mm256_fmadd_ps(e3, _mm256_setr_ps(3, 3, 3, 3, 7, 7, 7, 7), wsum);
+
+    __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    __m128 wsum4 = _mm_add_ps(_mm256_castps256_ps128(wsum), _mm256_extractf128_ps(wsum, 1));
+    _mm_storeu_ps(dis_pred, _mm_mul_ps(_mm_div_ps(wsum4, sum4), _mm_set1_ps(stride)));
+}
+#elif defined(__SSE2__)
+static inline __m128 fast_exp_sse(__m128 x)
+{
+    x = _mm_max_ps(x, _mm_set1_ps(FAST_EXP_MIN));
+    __m128 t = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.4426950409f * (1 << 23))), _mm_set1_ps(126.93490512f * (1 << 23)));
+    return _mm_castsi128_ps(_mm_cvttps_epi32(t));
+}
+
+// reg_max == 7: the two 4x4 halves of the 4x8 block are transposed so that lane k of c[j] holds
+// bin j of side k, then all four sides are reduced side by side with vertical operations only
+static void dfl_decode_distances_8(const float* dfl_det, float stride, float* dis_pred)
+{
+    __m128 c[8];
+    for (int half = 0; half < 2; half++)
+    {
+        __m128 r0 = _mm_loadu_ps(dfl_det + half * 4);
+        __m128 r1 = _mm_loadu_ps(dfl_det + 8 + half * 4);
+        __m128 r2 = _mm_loadu_ps(dfl_det + 16 + half * 4);
+        __m128 r3 = _mm_loadu_ps(dfl_det + 24 + half * 4);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        c[half * 4 + 0] = r0;
+        c[half * 4 + 1] = r1;
+        c[half * 4 + 2] = r2;
+        c[half * 4 + 3] = r3;
+    }
+
+    __m128 alpha = c[0];
+    for (int j = 1; j < 8; j++)
+        alpha = _mm_max_ps(alpha, c[j]);
+
+    __m128 sum = _mm_setzero_ps();
+    __m128 wsum = _mm_setzero_ps();
+    for (int j = 0; j < 8; j++)
+    {
+        __m128 e = fast_exp_sse(_mm_sub_ps(c[j], alpha));
+        sum = _mm_add_ps(sum, e);
+        wsum = _mm_add_ps(wsum, _mm_mul_ps(e, _mm_set1_ps((float)j)));
+    }
+    _mm_storeu_ps(dis_pred, _mm_mul_ps(_mm_div_ps(wsum, sum), _mm_set1_ps(stride)));
+}
+#elif defined(__ARM_NEON)
+static inline float32x4_t fast_exp_neon(float32x4_t x)
+{
+    x = vmaxq_f32(x, vdupq_n_f32(FAST_EXP_MIN));
+    float32x4_t t = vmlaq_f32(vdupq_n_f32(126.93490512f * (1 << 23)), x, vdupq_n_f32(1.4426950409f * (1 << 23)));
+    return vreinterpretq_f32_s32(vcvtq_s32_f32(t));
+}
+
+// reg_max == 7: the two 4x4 halves of the 4x8 block are transposed with vtrn so that lane k of c[j]
+// holds bin j of side k, then all four sides are reduced side by side with vertical operations only
+static void dfl_decode_distances_8(const float* dfl_det, float stride, float* dis_pred)
+{
+    float32x4_t c[8];
+    for (int half = 0; half < 2; half++)
+    {
+        float32x4_t r0 = vld1q_f32(dfl_det + half * 4);
+        float32x4_t r1 = vld1q_f32(dfl_det + 8 + half * 4);
+        float32x4_t r2 = vld1q_f32(dfl_det + 16 + half * 4);
+        float32x4_t r3 = vld1q_f32(dfl_det + 24 + half * 4);
+        // 4x4 transpose
+        float32x4x2_t t01 = vtrnq_f32(r0, r1);
+        float32x4x2_t t23 = vtrnq_f32(r2, r3);
+        c[half * 4 + 0] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+        c[half * 4 + 1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+        c[half * 4 + 2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+        c[half * 4 + 3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+    }
+
+    float32x4_t alpha = c[0];
+    for (int j = 1; j < 8; j++)
+        alpha = vmaxq_f32(alpha, c[j]);
+
+    float32x4_t sum = vdupq_n_f32(0.f);
+    float32x4_t wsum = vdupq_n_f32(0.f);
+    for (int j = 0; j < 8; j++)
+    {
+        float32x4_t e = fast_exp_neon(vsubq_f32(c[j], alpha));
+        sum = vaddq_f32(sum, e);
+        wsum = vmlaq_n_f32(wsum, e, (float)j);
+    }
+
+    // no vector division on armv7, two Newton steps on the reciprocal estimate are enough here
+    float32x4_t inv = vrecpeq_f32(sum);
+    inv = vmulq_f32(vrecpsq_f32(sum, inv), inv);
+    inv = vmulq_f32(vrecpsq_f32(sum, inv), inv);
+    vst1q_f32(dis_pred, vmulq_n_f32(vmulq_f32(wsum, inv), stride));
+}
+#endif
+
+void dfl_decode_distances(const float* dfl_det, int reg_max, float stride, float* dis_pred)
+{
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON)
+    if (reg_max == 7)
+    {
+        dfl_decode_distances_8(dfl_det, stride, dis_pred);
+        return;
+    }
+#endif
+    dfl_decode_distances_scalar(dfl_det, reg_max, stride, dis_pred);
+}
+
+// rows are visited 4 (8 with AVX2) at a time: the class scores of the block are gathered lane per row,
+// reduced to the per-row max and compared against the threshold, so a block without any candidate
+// costs one compare and one movemask. Only the surviving rows are written out.
+int scan_scores_above(const float* feats, int num_rows, int row_stride, int num_class, float threshold, int* indices)
+{
+    int count = 0;
+    int idx = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(row_stride));
+    const __m256 thresh = _mm256_set1_ps(threshold);
+    for (; idx + 8 <= num_rows; idx += 8)
+    {
+        const float* block = feats + (size_t)idx * row_stride;
+        __m256 m = _mm256_setzero_ps();
+        for (int c = 0; c < num_class; c++)
+            m = _mm256_max_ps(m, _mm256_i32gather_ps(block + c, offsets, 4));
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(m, thresh, _CMP_GT_OQ));
+        while (mask)
+        {
+            int lane = __builtin_ctz(mask);
+            indices[count++] = idx + lane;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128 thresh = _mm_set1_ps(threshold);
+    for (; idx + 4 <= num_rows; idx += 4)
+    {
+        const float* r0 = feats + (size_t)idx * row_stride;
+        const float* r1 = r0 + row_stride;
+        const float* r2 = r1 + row_stride;
+        const float* r3 = r2 + row_stride;
+        __m128 m = _mm_setzero_ps();
+        for (int c = 0; c < num_class; c++)
+            m = _mm_max_ps(m, _mm_setr_ps(r0[c], r1[c], r2[c], r3[c]));
+        int mask = _mm_movemask_ps(_mm_cmpgt_ps(m, thresh));
+        while (mask)
+        {
+            int lane = __builtin_ctz(mask);
+            indices[count++] = idx + lane;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t thresh = vdupq_n_f32(threshold);
+    const uint32x4_t lane_bits = { 1, 2, 4, 8 };
+    for (; idx + 4 <= num_rows; idx += 4)
+    {
+        const float* r0 = feats + (size_t)idx * row_stride;
+        const float* r1 = r0 + row_stride;
+        const float* r2 = r1 + row_stride;
+        const float* r3 = r2 + row_stride;
+        float32x4_t m = vdupq_n_f32(0.f);
+        for (int c = 0; c < num_class; c++)
+        {
+            float32x4_t v = vdupq_n_f32(r0[c]);
+            v = vsetq_lane_f32(r1[c], v, 1);
+            v = vsetq_lane_f32(r2[c], v, 2);
+            v = vsetq_lane_f32(r3[c], v, 3);
+            m = vmaxq_f32(m, v);
+        }
+        uint32x4_t bits = vandq_u32(vcgtq_f32(m, thresh), lane_bits);
+        uint32x2_t half = vorr_u32(vget_low_u32(bits), vget_high_u32(bits));
+        int mask = (int)(vget_lane_u32(half, 0) | vget_lane_u32(half, 1));
+        while (mask)
+        {
+            int lane = __builtin_ctz(mask);
+            indices[count++] = idx + lane;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; idx < num_rows; idx++)
+    {
+        int label;
+        if (row_max_score(feats + (size_t)idx * row_stride, num_class, label) > threshold)
+            indices[count++] = idx;
+    }
+    return count;
+}
@@ -0,0 +1,44 @@
+#ifndef NANODET_KERNELS_H
+#define NANODET_KERNELS_H
+
+#include <stdint.h>
+
+// the hot loops of the NanoDet post-processing, vectorized with AVX2/SSE on x86 and NEON on ARM,
+// falling back to plain C++ elsewhere. None of them touches the heap.
+
+inline float fast_exp(float x)
+{
+    union {
+        uint32_t i;
+        float f;
+    } v{};
+    v.i = (1 << 23) * (1.4426950409 * x + 126.93490512f);
+    return v.f;
+}
+
+// decode the distribution-focal-loss logits of one candidate, 4 sides x (reg_max + 1) bins laid out
+// side by side, into the distances left, top, right, bottom (in pixels, already scaled by stride)
+void dfl_decode_distances(const float* dfl_det, int reg_max, float stride, float* dis_pred);
+
+// scan num_rows rows of row_stride floats starting with num_class class scores and write the indices
+// of the rows whose best score (floored at 0, as in decode_infer) is above threshold to indices,
+// which must hold num_rows entries. Returns the number of surviving rows.
+int scan_scores_above(const float* feats, int num_rows, int row_stride, int num_class, float threshold, int* indices);
+
+// best class score of one row, floored at 0 like the original per-row loop
+inline float row_max_score(const float* scores, int num_class, int& label)
+{
+    float score = 0;
+    label = 0;
+    for (int c = 0; c < num_class; c++)
+    {
+        if (scores[c] > score)
+        {
+            score = scores[c];
+            label = c;
+        }
+    }
+    return score;
+}
+
+#endif //NANODET_KERNELS_H
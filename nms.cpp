@@ -0,0 +1,208 @@
+#include "nms.h"
+#include "nanodet.h"
+#include <algorithm>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define NMS_BLOCK 8
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define NMS_BLOCK 4
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define NMS_BLOCK 4
+#else
+#define NMS_BLOCK 4
+#endif
+
+struct BoxArrays
+{
+    const float* x1;
+    const float* y1;
+    const float* x2;
+    const float* y2;
+    const float* area;
+    const int* label;
+};
+
+// bit k is set if box j + k overlaps box i by at least nms_threshold (and has the same label when
+// class_aware). The arithmetic follows the scalar NanoDet::nms step by step so the decisions match.
+static inline unsigned overlap_mask(const BoxArrays& b, int i, int j, float nms_threshold, bool class_aware)
+{
+#if defined(__AVX2__) && defined(__FMA__)
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 xx1 = _mm256_max_ps(_mm256_set1_ps(b.x1[i]), _mm256_loadu_ps(b.x1 + j));
+    __m256 yy1 = _mm256_max_ps(_mm256_set1_ps(b.y1[i]), _mm256_loadu_ps(b.y1 + j));
+    __m256 xx2 = _mm256_min_ps(_mm256_set1_ps(b.x2[i]), _mm256_loadu_ps(b.x2 + j));
+    __m256 yy2 = _mm256_min_ps(_mm256_set1_ps(b.y2[i]), _mm256_loadu_ps(b.y2 + j));
+    __m256 w = _mm256_max_ps(zero, _mm256_add_ps(_mm256_sub_ps(xx2, xx1), one));
+    __m256 h = _mm256_max_ps(zero, _mm256_add_ps(_mm256_sub_ps(yy2, yy1), one));
+    __m256 inter = _mm256_mul_ps(w, h);
+    __m256 uni = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(b.area[i]), _mm256_loadu_ps(b.area + j)), inter);
+    __m256 ovr = _mm256_div_ps(inter, uni);
+    __m256 hit = _mm256_cmp_ps(ovr, _mm256_set1_ps(nms_threshold), _CMP_GE_OQ);
+    if (class_aware)
+    {
+        __m256i same = _mm256_cmpeq_epi32(_mm256_set1_epi32(b.label[i]), _mm256_loadu_si256((const __m256i*)(b.label + j)));
+        hit = _mm256_and_ps(hit, _mm256_castsi256_ps(same));
+    }
+    return (unsigned)_mm256_movemask_ps(hit);
+#elif defined(__SSE2__)
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 xx1 = _mm_max_ps(_mm_set1_ps(b.x1[i]), _mm_loadu_ps(b.x1 + j));
+    __m128 yy1 = _mm_max_ps(_mm_set1_ps(b.y1[i]), _mm_loadu_ps(b.y1 + j));
+    __m128 xx2 = _mm_min_ps(_mm_set1_ps(b.x2[i]), _mm_loadu_ps(b.x2 + j));
+    __m128 yy2 = _mm_min_ps(_mm_set1_ps(b.y2[i]), _mm_loadu_ps(b.y2 + j));
+    __m128 w = _mm_max_ps(zero, _mm_add_ps(_mm_sub_ps(xx2, xx1), one));
+    __m128 h = _mm_max_ps(zero, _mm_add_ps(_mm_sub_ps(yy2, yy1), one));
+    __m128 inter = _mm_mul_ps(w, h);
+    __m128 uni = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(b.area[i]), _mm_loadu_ps(b.area + j)), inter);
+    __m128 ovr = _mm_div_ps(inter, uni);
+    __m128 hit = _mm_cmpge_ps(ovr, _mm_set1_ps(nms_threshold));
+    if (class_aware)
+    {
+        __m128i same = _mm_cmpeq_epi32(_mm_set1_epi32(b.label[i]), _mm_loadu_si128((const __m128i*)(b.label + j)));
+        hit = _mm_and_ps(hit, _mm_castsi128_ps(same));
+    }
+    return (unsigned)_mm_movemask_ps(hit);
+#elif defined(__ARM_NEON)
+    const float32x4_t one = vdupq_n_f32(1.f);
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    float32x4_t xx1 = vmaxq_f32(vdupq_n_f32(b.x1[i]), vld1q_f32(b.x1 + j));
+    float32x4_t yy1 = vmaxq_f32(vdupq_n_f32(b.y1[i]), vld1q_f32(b.y1 + j));
+    float32x4_t xx2 = vminq_f32(vdupq_n_f32(b.x2[i]), vld1q_f32(b.x2 + j));
+    float32x4_t yy2 = vminq_f32(vdupq_n_f32(b.y2[i]), vld1q_f32(b.y2 + j));
+    float32x4_t w = vmaxq_f32(zero, vaddq_f32(vsubq_f32(xx2, xx1), one));
+    float32x4_t h = vmaxq_f32(zero, vaddq_f32(vsubq_f32(yy2, yy1), one));
+    float32x4_t inter = vmulq_f32(w, h);
+    float32x4_t uni = vsubq_f32(vaddq_f32(vdupq_n_f32(b.area[i]), vld1q_f32(b.area + j)), inter);
+    // the threshold decision has to be exact, so no reciprocal estimate here
+    float ovr_lanes[4];
+    float inter_lanes[4];
+    float uni_lanes[4];
+    vst1q_f32(inter_lanes, inter);
+    vst1q_f32(uni_lanes, uni);
+    for (int k = 0; k < 4; k++)
+        ovr_lanes[k] = inter_lanes[k] / uni_lanes[k];
+    uint32x4_t hit = vcgeq_f32(vld1q_f32(ovr_lanes), vdupq_n_f32(nms_threshold));
+    if (class_aware)
+        hit = vandq_u32(hit, vceqq_s32(vdupq_n_s32(b.label[i]), vld1q_s32(b.label + j)));
+    const uint32x4_t lane_bits = { 1, 2, 4, 8 };
+    uint32x4_t bits = vandq_u32(hit, lane_bits);
+    uint32x2_t half = vorr_u32(vget_low_u32(bits), vget_high_u32(bits));
+    return vget_lane_u32(half, 0) | vget_lane_u32(half, 1);
+#else
+    unsigned mask = 0;
+    for (int k = 0; k < NMS_BLOCK; k++)
+    {
+        float xx1 = (std::max)(b.x1[i], b.x1[j + k]);
+        float yy1 = (std::max)(b.y1[i], b.y1[j + k]);
+        float xx2 = (std::min)(b.x2[i], b.x2[j + k]);
+        float yy2 = (std::min)(b.y2[i], b.y2[j + k]);
+        float w = (std::max)(float(0), xx2 - xx1 + 1);
+        float h = (std::max)(float(0), yy2 - yy1 + 1);
+        float inter = w * h;
+        float ovr = inter / (b.area[i] + b.area[j + k] - inter);
+        if (ovr >= nms_threshold && (!class_aware || b.label[i] == b.label[j + k]))
+            mask |= 1u << k;
+    }
+    return mask;
+#endif
+}
+
+int NmsEngine::suppress(const std::vector<BoxInfo>& boxes, float nms_threshold, bool class_aware)
+{
+    const int n = (int)boxes.size();
+    // padded to whole blocks so the last block can be loaded without a scalar tail
+    const int padded = (n + 7) / 8 * 8;
+
+    this->order.resize(n);
+    for (int i = 0; i < n; i++)
+        this->order[i] = i;
+    // ties broken by the input position so the result does not depend on the sort implementation
+    std::sort(this->order.begin(), this->order.end(), [&boxes](int a, int b) {
+        return boxes[a].score > boxes[b].score || (boxes[a].score == boxes[b].score && a < b);
+    });
+
+    this->x1.assign(padded, 0.f);
+    this->y1.assign(padded, 0.f);
+    this->x2.assign(padded, 0.f);
+    this->y2.assign(padded, 0.f);
+    this->area.assign(padded, 1.f);
+    this->score.assign(padded, 0.f);
+    this->label.assign(padded, -1);
+    for (int i = 0; i < n; i++)
+    {
+        const BoxInfo& box = boxes[this->order[i]];
+        this->x1[i] = box.x1;
+        this->y1[i] = box.y1;
+        this->x2[i] = box.x2;
+        this->y2[i] = box.y2;
+        this->area[i] = (box.x2 - box.x1 + 1) * (box.y2 - box.y1 + 1);
+        this->score[i] = box.score;
+        this->label[i] = box.label;
+    }
+
+    this->suppressed.assign((padded + 63) / 64, 0);
+    this->keep.clear();
+
+    BoxArrays arrays = { this->x1.data(), this->y1.data(), this->x2.data(), this->y2.data(), this->area.data(), this->label.data() };
+    uint64_t* bits = this->suppressed.data();
+    for (int i = 0; i < n; i++)
+    {
+        if (bits[i >> 6] & ((uint64_t)1 << (i & 63)))
+            continue;
+        this->keep.push_back(i);
+
+        // blocks are aligned to NMS_BLOCK, which divides 64, so a block never straddles two words
+        int j = (i + 1) / NMS_BLOCK * NMS_BLOCK;
+        unsigned first_mask = ~((1u << (i + 1 - j)) - 1);
+        for (; j < n; j += NMS_BLOCK)
+        {
+            unsigned mask = overlap_mask(arrays, i, j, nms_threshold, class_aware) & first_mask;
+            first_mask = ~0u;
+            bits[j >> 6] |= (uint64_t)mask << (j & 63);
+        }
+    }
+    return (int)this->keep.size();
+}
+
+void NmsEngine::run(std::vector<BoxInfo>& boxes, float nms_threshold)
+{
+    const int num_kept = this->suppress(boxes, nms_threshold, false);
+
+    // the kept boxes are rebuilt from the sorted arrays, so boxes can be overwritten in place
+    boxes.resize(num_kept);
+    for (int k = 0; k < num_kept; k++)
+    {
+        const int i = this->keep[k];
+        boxes[k] = BoxInfo { this->x1[i], this->y1[i], this->x2[i], this->y2[i], this->score[i], this->label[i] };
+    }
+}
+
+void NmsEngine::run_batched(const std::vector<BoxInfo>& boxes, float nms_threshold, std::vector<BoxInfo>& kept)
+{
+    const int num_kept = this->suppress(boxes, nms_threshold, true);
+
+    // stable insertion sort by label, the kept list is short and already in descending score order
+    for (int k = 1; k < num_kept; k++)
+    {
+        const int i = this->keep[k];
+        int m = k;
+        while (m > 0 && this->label[this->keep[m - 1]] > this->label[i])
+        {
+            this->keep[m] = this->keep[m - 1];
+            m--;
+        }
+        this->keep[m] = i;
+    }
+
+    kept.resize(num_kept);
+    for (int k = 0; k < num_kept; k++)
+    {
+        const int i = this->keep[k];
+        kept[k] = BoxInfo { this->x1[i], this->y1[i], this->x2[i], this->y2[i], this->score[i], this->label[i] };
+    }
+}
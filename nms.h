@@ -0,0 +1,40 @@
+#ifndef NMS_H
+#define NMS_H
+
+#include <vector>
+#include <stdint.h>
+
+struct BoxInfo;
+
+// greedy non-maximum suppression on index order and coordinate arrays: boxes are sorted by index,
+// kept as x1/y1/x2/y2/area arrays, compared against each kept box a SIMD block at a time and
+// suppressed by setting a bit, nothing is erased. The IoU is computed exactly as the former
+// NanoDet::nms (pixel-inclusive areas, suppressed when IoU >= threshold), so the kept boxes are the same.
+// The buffers are kept between calls, one engine must not be used by several threads at once.
+class NmsEngine
+{
+public:
+    // single class: boxes is replaced by the kept boxes in descending score order
+    void run(std::vector<BoxInfo>& boxes, float nms_threshold);
+
+    // class-aware, all classes in one pass: a box is only suppressed by a box of its own label.
+    // kept is grouped by ascending label, each label in descending score order, i.e. the same order
+    // as running run() per label and concatenating the results.
+    void run_batched(const std::vector<BoxInfo>& boxes, float nms_threshold, std::vector<BoxInfo>& kept);
+
+private:
+    int suppress(const std::vector<BoxInfo>& boxes, float nms_threshold, bool class_aware);
+
+    std::vector<int> order;
+    std::vector<int> keep;
+    std::vector<float> x1;
+    std::vector<float> y1;
+    std::vector<float> x2;
+    std::vector<float> y2;
+    std::vector<float> area;
+    std::vector<float> score;
+    std::vector<int> label;
+    std::vector<uint64_t> suppressed;
+};
+
+#endif //NMS_H
@@ -18,16 +18,43 @@ QMAKE_CXXFLAGS+= -fopenmp
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    box_flow.cpp \
+    box_tracker.cpp \
+    camera_scheduler.cpp \
+    detection_gate.cpp \
+    door_events.cpp \
+    inference_context.cpp \
     jsoncpp.cpp \
+    letterbox.cpp \
     main.cpp \
     mainwindow.cpp \
-    nanodet.cpp
+    nanodet.cpp \
+    nanodet_kernels.cpp \
+    nms.cpp \
+    tiled_detection.cpp \
+    v4l2_capture.cpp
 
 HEADERS += \
+    bounded_queue.h \
+    box_flow.h \
+    box_tracker.h \
+    camera_scheduler.h \
+    detection_gate.h \
+    door_events.h \
+    door_results.h \
+    frame_bus.h \
+    inference_context.h \
     json-forwards.h \
     json.h \
+    latest_frame.h \
+    letterbox.h \
     mainwindow.h \
-    nanodet.h
+    nanodet.h \
+    nanodet_kernels.h \
+    nms.h \
+    result_ring.h \
+    tiled_detection.h \
+    v4l2_capture.h
 
 FORMS += \
     mainwindow.ui
@@ -45,6 +72,7 @@ LIBS += /usr/local/lib/libopencv_highgui.so \
         /usr/local/lib/libopencv_video.so \
         /usr/local/lib/libopencv_videoio.so \
         /usr/local/lib/libncnn.a \
+        -lrt
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
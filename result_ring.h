@@ -0,0 +1,432 @@
+#ifndef RESULT_RING_H
+#define RESULT_RING_H
+
+/*
+ * The shared memory the detector publishes its results through, plain C so the consumers can include
+ * it as it is. The segment is a header followed by slot_count slots of slot_size bytes of message.
+ * Message n (counted from 1) goes to slot (n - 1) % slot_count; the writer never waits for the
+ * readers, a reader slower than slot_count messages loses the oldest ones and continues with the
+ * oldest message still in the ring.
+ *
+ * Each slot is a seqlock: its sequence is 2n - 1 while message n is written and 2n once it is
+ * complete, so a reader copies a message out and keeps it only if the sequence did not change meanwhile.
+ * A reader keeps its own cursor, the next message it wants. Registered readers (result_ring_attach)
+ * publish it in the header and every message is lost to them exactly once: the reader claims the
+ * message by moving its published cursor past it before the copy and counts it in its overruns itself
+ * when the copy turns out overwritten, the writer moves the cursor of a reader still before a message
+ * it overwrites past it and counts the message for the reader.
+ *
+ * Waking up: every message bumps the futex word of the header, a reader with nothing to read sleeps
+ * on it in result_ring_wait. The writer only makes the FUTEX_WAKE system call when a reader sleeps,
+ * so a publish costs no system call at all while the readers are busy or polling; the calls made are
+ * counted in wakeups. A registered reader sleeps in its own entry, so the sleep of a reader killed in
+ * result_ring_wait is cleared with its entry (by the next attach or writer start) instead of having
+ * every later publish make the system call. Every slot holds the CLOCK_MONOTONIC time of its publish, the wake-up latency of
+ * a reader is the time it got the message minus that.
+ *
+ * Restarts: the segment outlives the writer. A writer started again on a ring of the same geometry
+ * continues it (head, cursors and counters stay, generation counts the starts), the readers simply
+ * get the next messages. A ring the new writer cannot reuse is marked closed before it is replaced,
+ * which wakes the readers with -1 from result_ring_wait to open the new one by name.
+ *
+ * Single writer, any number of readers in any number of processes. Linux only (futex).
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RESULT_RING_MAGIC 0x44525252u /* "RRRD" */
+#define RESULT_RING_VERSION 2
+#define RESULT_RING_MAX_READERS 8
+#define RESULT_RING_ALIGN 64
+
+typedef struct ResultRingReader
+{
+    uint32_t pid; /* the registered process, 0 for a free entry */
+    uint32_t sleeping; /* the reader sleeps on the futex */
+    uint64_t cursor; /* the next message the reader wants */
+    uint64_t overruns; /* messages overwritten before this reader read them */
+} ResultRingReader;
+
+typedef struct ResultRingHeader
+{
+    uint32_t magic; /* written last, RESULT_RING_MAGIC once the ring is ready */
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size; /* the largest message */
+    uint64_t head; /* messages published so far, the newest one is message head */
+    uint64_t overruns; /* messages overwritten before a registered reader read them, all readers */
+    uint64_t oversized; /* messages larger than slot_size the writer dropped */
+    uint32_t futex; /* bumped by every message, the readers sleep on it */
+    uint32_t waiters; /* unregistered readers sleeping on the futex, the registered ones in their entry */
+    uint64_t wakeups; /* FUTEX_WAKE system calls of the writer */
+    uint32_t writer_pid; /* the running writer, 0 after it stopped */
+    uint32_t closed; /* replaced by a new ring, to be opened again by name */
+    uint64_t generation; /* writer starts on this ring */
+    ResultRingReader readers[RESULT_RING_MAX_READERS];
+} ResultRingHeader;
+
+typedef struct ResultRingSlot
+{
+    uint64_t sequence; /* 2n - 1 while message n is written, 2n once complete */
+    uint32_t length; /* bytes of the message, which follows the slot header */
+    uint32_t reserved;
+    uint64_t publish_ns; /* CLOCK_MONOTONIC time of the publish */
+} ResultRingSlot;
+
+#define RESULT_RING_ROUND(size) (((size) + RESULT_RING_ALIGN - 1) & ~(size_t)(RESULT_RING_ALIGN - 1))
+
+static inline size_t result_ring_slot_stride(uint32_t slot_size)
+{
+    return RESULT_RING_ROUND(sizeof(ResultRingSlot) + slot_size);
+}
+
+/* the bytes of the segment of a ring */
+static inline size_t result_ring_size(uint32_t slot_count, uint32_t slot_size)
+{
+    return RESULT_RING_ROUND(sizeof(ResultRingHeader)) + (size_t)slot_count * result_ring_slot_stride(slot_size);
+}
+
+static inline ResultRingSlot* result_ring_slot(ResultRingHeader* ring, uint64_t sequence)
+{
+    char* slots = (char*)ring + RESULT_RING_ROUND(sizeof(ResultRingHeader));
+    return (ResultRingSlot*)(slots + (size_t)((sequence - 1) % ring->slot_count) * result_ring_slot_stride(ring->slot_size));
+}
+
+static inline uint64_t result_ring_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static inline long result_ring_futex(uint32_t* word, int op, uint32_t value, const struct timespec* timeout)
+{
+    return syscall(SYS_futex, word, op, value, timeout, NULL, 0);
+}
+
+/* non-zero once the writer has set the ring up */
+static inline int result_ring_ready(ResultRingHeader* ring)
+{
+    return __atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) == RESULT_RING_MAGIC && ring->version == RESULT_RING_VERSION;
+}
+
+/* non-zero when the registered process of the entry is gone without detaching */
+static inline int result_ring_reader_dead(uint32_t pid)
+{
+    return pid != 0 && kill((pid_t)pid, 0) == -1 && errno == ESRCH;
+}
+
+/* writer: any reader sleeping on the futex */
+static inline int result_ring_sleepers(ResultRingHeader* ring)
+{
+    if (__atomic_load_n(&ring->waiters, __ATOMIC_SEQ_CST) != 0)
+        return 1;
+    for (int r = 0; r < RESULT_RING_MAX_READERS; r++)
+    {
+        if (__atomic_load_n(&ring->readers[r].sleeping, __ATOMIC_SEQ_CST) != 0)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * writer: sets the ring up in a segment of result_ring_size(slot_count, slot_size) bytes and registers
+ * the calling process as its writer. The ring a previous run of the writer left with the same geometry
+ * is continued as it is, so the attached readers keep their cursors across a restart of the detector.
+ * Returns 1 when the ring was continued, 0 when it was set up anew.
+ */
+static inline int result_ring_init(ResultRingHeader* ring, uint32_t slot_count, uint32_t slot_size)
+{
+    int continued = result_ring_ready(ring) && !ring->closed && ring->slot_count == slot_count && ring->slot_size == slot_size;
+    if (!continued)
+    {
+        __atomic_store_n(&ring->magic, 0, __ATOMIC_RELEASE);
+        memset((char*)ring + sizeof(ring->magic), 0, result_ring_size(slot_count, slot_size) - sizeof(ring->magic));
+        ring->version = RESULT_RING_VERSION;
+        ring->slot_count = slot_count;
+        ring->slot_size = slot_size;
+    }
+    /* a reader killed while it slept leaves its entry sleeping */
+    for (int r = 0; r < RESULT_RING_MAX_READERS; r++)
+    {
+        if (result_ring_reader_dead(__atomic_load_n(&ring->readers[r].pid, __ATOMIC_ACQUIRE)))
+            __atomic_store_n(&ring->readers[r].sleeping, 0, __ATOMIC_RELEASE);
+    }
+    ring->generation++;
+    __atomic_store_n(&ring->writer_pid, (uint32_t)getpid(), __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->magic, RESULT_RING_MAGIC, __ATOMIC_RELEASE);
+    return continued;
+}
+
+/* writer: wakes every sleeping reader, without a system call when none sleeps */
+static inline void result_ring_notify(ResultRingHeader* ring)
+{
+    /* sequentially consistent with the sleep marks of result_ring_wait: either the writer sees the
+       sleeping reader, or the reader sees the bumped word and does not sleep */
+    __atomic_fetch_add(&ring->futex, 1, __ATOMIC_SEQ_CST);
+    if (!result_ring_sleepers(ring))
+        return;
+    result_ring_futex(&ring->futex, FUTEX_WAKE, INT_MAX, NULL);
+    __atomic_fetch_add(&ring->wakeups, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * writer: the writer stops. With closed the ring is about to be replaced and the readers are told to
+ * open the new one, otherwise a restarted writer continues it.
+ */
+static inline void result_ring_stop(ResultRingHeader* ring, int closed)
+{
+    __atomic_store_n(&ring->writer_pid, 0, __ATOMIC_RELEASE);
+    if (closed)
+        __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+    result_ring_notify(ring);
+}
+
+/* writer: publishes a message and wakes the readers, never waits. 0 if it is larger than slot_size and was dropped */
+static inline int result_ring_write(ResultRingHeader* ring, const void* data, uint32_t length)
+{
+    if (length > ring->slot_size)
+    {
+        __atomic_fetch_add(&ring->oversized, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    const uint64_t sequence = __atomic_load_n(&ring->head, __ATOMIC_RELAXED) + 1;
+    ResultRingSlot* slot = result_ring_slot(ring, sequence);
+
+    /* the slot holds message sequence - slot_count, lost to the registered readers which did not claim
+       it yet: their cursor is moved past it, a reader claiming it at the same time loses the race */
+    if (sequence > ring->slot_count)
+    {
+        const uint64_t overwritten = sequence - ring->slot_count;
+        for (int r = 0; r < RESULT_RING_MAX_READERS; r++)
+        {
+            ResultRingReader* reader = &ring->readers[r];
+            if (__atomic_load_n(&reader->pid, __ATOMIC_ACQUIRE) == 0)
+                continue;
+            uint64_t cursor = __atomic_load_n(&reader->cursor, __ATOMIC_ACQUIRE);
+            while (cursor <= overwritten)
+            {
+                if (__atomic_compare_exchange_n(&reader->cursor, &cursor, overwritten + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                {
+                    __atomic_fetch_add(&reader->overruns, overwritten + 1 - cursor, __ATOMIC_RELAXED);
+                    __atomic_fetch_add(&ring->overruns, overwritten + 1 - cursor, __ATOMIC_RELAXED);
+                    break;
+                }
+            }
+        }
+    }
+
+    __atomic_store_n(&slot->sequence, 2 * sequence - 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(slot + 1, data, length);
+    __atomic_store_n(&slot->length, length, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->publish_ns, result_ring_now_ns(), __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->sequence, 2 * sequence, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, sequence, __ATOMIC_RELEASE);
+    result_ring_notify(ring);
+    return 1;
+}
+
+/*
+ * reader: maps the ring the writer created with shm_open(name), NULL while there is none (yet) or
+ * only the closed one about to be replaced.
+ * size receives the bytes to give to result_ring_unmap.
+ */
+static inline ResultRingHeader* result_ring_map(const char* name, size_t* size)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1)
+        return NULL;
+    struct stat info;
+    void* memory = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(ResultRingHeader))
+        memory = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        return NULL;
+    ResultRingHeader* ring = (ResultRingHeader*)memory;
+    if (!result_ring_ready(ring) || __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)
+        || result_ring_size(ring->slot_count, ring->slot_size) > (size_t)info.st_size)
+    {
+        munmap(memory, (size_t)info.st_size);
+        return NULL;
+    }
+    *size = (size_t)info.st_size;
+    return ring;
+}
+
+static inline void result_ring_unmap(ResultRingHeader* ring, size_t size)
+{
+    munmap(ring, size);
+}
+
+/*
+ * reader: registers the calling process so the writer counts its overruns, and sets the cursor to
+ * the next message to come. Returns the reader index for result_ring_read/result_ring_detach, or -1
+ * when all the entries are taken. The entries of processes which died without detaching are reused.
+ */
+static inline int result_ring_attach(ResultRingHeader* ring, uint64_t* cursor)
+{
+    const uint32_t pid = (uint32_t)getpid();
+    for (int r = 0; r < RESULT_RING_MAX_READERS; r++)
+    {
+        ResultRingReader* reader = &ring->readers[r];
+        uint32_t owner = __atomic_load_n(&reader->pid, __ATOMIC_ACQUIRE);
+        if (owner != 0 && !result_ring_reader_dead(owner))
+            continue;
+        if (!__atomic_compare_exchange_n(&reader->pid, &owner, pid, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            continue;
+        __atomic_store_n(&reader->sleeping, 0, __ATOMIC_RELEASE);
+        *cursor = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) + 1;
+        __atomic_store_n(&reader->overruns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&reader->cursor, *cursor, __ATOMIC_RELEASE);
+        return r;
+    }
+    return -1;
+}
+
+static inline void result_ring_detach(ResultRingHeader* ring, int reader)
+{
+    if (reader >= 0)
+        __atomic_store_n(&ring->readers[reader].pid, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * reader: moves the cursor of a registered reader to message to, e.g. back to the first message of a
+ * ring which replaced a closed one. The published cursor has to follow, the messages before it are
+ * left to the writer.
+ */
+static inline void result_ring_seek(ResultRingHeader* ring, int reader, uint64_t* cursor, uint64_t to)
+{
+    *cursor = to;
+    if (reader >= 0)
+        __atomic_store_n(&ring->readers[reader].cursor, to, __ATOMIC_RELEASE);
+}
+
+/*
+ * reader: sleeps until message cursor is published, up to timeout_ms (-1 for no limit). Returns 1
+ * when it is there, 0 on the timeout, -1 when the ring was closed and has to be mapped again. reader
+ * is the index of result_ring_attach, or -1 for an unregistered reader.
+ */
+static inline int result_ring_wait(ResultRingHeader* ring, int reader, uint64_t cursor, int timeout_ms)
+{
+    uint32_t* sleeping = reader >= 0 ? &ring->readers[reader].sleeping : &ring->waiters;
+    const uint64_t deadline = timeout_ms >= 0 ? result_ring_now_ns() + (uint64_t)timeout_ms * 1000000ull : 0;
+    for (;;)
+    {
+        const uint32_t seen = __atomic_load_n(&ring->futex, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >= cursor)
+            return 1;
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+            return -1;
+
+        struct timespec timeout;
+        if (timeout_ms >= 0)
+        {
+            const uint64_t now = result_ring_now_ns();
+            if (now >= deadline)
+                return 0;
+            timeout.tv_sec = (time_t)((deadline - now) / 1000000000ull);
+            timeout.tv_nsec = (long)((deadline - now) % 1000000000ull);
+        }
+        __atomic_fetch_add(sleeping, 1, __ATOMIC_SEQ_CST);
+        /* returns at once when the word moved on since it was read */
+        result_ring_futex(&ring->futex, FUTEX_WAIT, seen, timeout_ms >= 0 ? &timeout : NULL);
+        __atomic_fetch_sub(sleeping, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/*
+ * reader: copies the message at the cursor into buffer and moves the cursor past it. Returns 1 with
+ * length set, 0 when there is no new message, -1 when the message does not fit into capacity (length
+ * is set to its size, the cursor stays). A cursor the writer has lapped jumps to the oldest message
+ * left. reader is the index of result_ring_attach, or -1 for an unregistered reader. publish_ns, if
+ * not NULL, receives the CLOCK_MONOTONIC time the message was published.
+ */
+static inline int result_ring_read_timed(ResultRingHeader* ring, int reader, uint64_t* cursor, void* buffer, uint32_t capacity,
+                                         uint32_t* length, uint64_t* publish_ns)
+{
+    for (;;)
+    {
+        const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t* published_cursor = reader >= 0 ? &ring->readers[reader].cursor : NULL;
+        /* the writer moved the cursor past the messages it overwrote, and counted them */
+        if (published_cursor)
+        {
+            const uint64_t moved = __atomic_load_n(published_cursor, __ATOMIC_ACQUIRE);
+            if (moved > *cursor)
+                *cursor = moved;
+        }
+        if (*cursor > head)
+            return 0;
+        if (*cursor == 0 || head - *cursor >= ring->slot_count)
+            *cursor = head >= ring->slot_count ? head - ring->slot_count + 1 : 1;
+
+        const uint64_t sequence = *cursor;
+        ResultRingSlot* slot = result_ring_slot(ring, sequence);
+        const uint64_t peeked = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        uint32_t size = __atomic_load_n(&slot->length, __ATOMIC_RELAXED);
+        if (peeked == 2 * sequence && size > capacity)
+        {
+            *length = size;
+            return -1;
+        }
+        /* claimed before the copy: from now on the writer leaves the message to this reader, unless it
+           moved the cursor past it first */
+        if (published_cursor)
+        {
+            uint64_t expected = __atomic_load_n(published_cursor, __ATOMIC_ACQUIRE);
+            while (expected <= sequence
+                   && !__atomic_compare_exchange_n(published_cursor, &expected, sequence + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                ;
+            if (expected > sequence)
+            {
+                *cursor = expected;
+                continue;
+            }
+        }
+
+        const uint64_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        size = __atomic_load_n(&slot->length, __ATOMIC_RELAXED);
+        const uint64_t published = __atomic_load_n(&slot->publish_ns, __ATOMIC_RELAXED);
+        if (size > ring->slot_size)
+            size = ring->slot_size;
+        memcpy(buffer, slot + 1, size < capacity ? size : capacity);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        const uint64_t after = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+        *cursor = sequence + 1;
+        if (before != 2 * sequence || after != before || size > capacity)
+        {
+            /* overwritten by a newer message before or while it was read, it is lost */
+            if (published_cursor)
+            {
+                __atomic_fetch_add(&ring->readers[reader].overruns, 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&ring->overruns, 1, __ATOMIC_RELAXED);
+            }
+            continue;
+        }
+        *length = size;
+        if (publish_ns)
+            *publish_ns = published;
+        return 1;
+    }
+}
+
+static inline int result_ring_read(ResultRingHeader* ring, int reader, uint64_t* cursor, void* buffer, uint32_t capacity, uint32_t* length)
+{
+    return result_ring_read_timed(ring, reader, cursor, buffer, capacity, length, NULL);
+}
+
+#endif /* RESULT_RING_H */
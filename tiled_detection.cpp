@@ -0,0 +1,150 @@
+#include "tiled_detection.h"
+#include <algorithm>
+#include <cmath>
+
+// fraction of a box inside a better box of its class from which it counts as a fragment cut by a seam
+#define FRAGMENT_INSIDE_RATIO 0.7f
+
+// first pixel of tile i of num tiles of size tile spread over [start, start + length)
+static int tile_start(int i, int num, int start, int length, int tile)
+{
+    if (num <= 1)
+        return start;
+    return start + (int)((long long)i * (length - tile) / (num - 1));
+}
+
+std::vector<cv::Rect> tile_grid(const cv::Rect& area, const TileConfig& tiles, bool even)
+{
+    const int cols = (std::max)(tiles.cols, 1);
+    const int rows = (std::max)(tiles.rows, 1);
+    const float overlap = (std::min)((std::max)(tiles.overlap, 0.f), 0.9f);
+    // n tiles of size t overlapping by overlap * t cover t * (n - (n - 1) * overlap)
+    int tile_w = (std::min)((int)ceil(area.width / (cols - (cols - 1) * overlap)), area.width);
+    int tile_h = (std::min)((int)ceil(area.height / (rows - (rows - 1) * overlap)), area.height);
+    if (even)
+    {
+        tile_w &= ~1;
+        tile_h &= ~1;
+    }
+
+    std::vector<cv::Rect> grid;
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            int x = tile_start(c, cols, area.x, area.width, tile_w);
+            int y = tile_start(r, rows, area.y, area.height, tile_h);
+            if (even)
+            {
+                x &= ~1;
+                y &= ~1;
+            }
+            grid.push_back(cv::Rect(x, y, tile_w, tile_h));
+        }
+    }
+    return grid;
+}
+
+std::vector<BoxInfo> merge_tile_boxes(const std::vector<BoxInfo>& boxes, float score_threshold, float nms_threshold)
+{
+    NmsEngine nms_engine;
+    std::vector<BoxInfo> dets;
+    nms_engine.run_batched(boxes, nms_threshold, dets);
+    std::vector<BoxInfo> merged = mergeDecision(dets, score_threshold, 0.05f);
+
+    // merged is in descending score order, a box is only checked against the better boxes kept before it
+    std::vector<BoxInfo> kept;
+    for (size_t i = 0; i < merged.size(); i++)
+    {
+        const BoxInfo& box = merged[i];
+        float area = (box.x2 - box.x1) * (box.y2 - box.y1);
+        bool fragment = false;
+        for (size_t k = 0; k < kept.size() && !fragment; k++)
+        {
+            const BoxInfo& better = kept[k];
+            if (better.label != box.label)
+                continue;
+            float w = (std::min)(box.x2, better.x2) - (std::max)(box.x1, better.x1);
+            float h = (std::min)(box.y2, better.y2) - (std::max)(box.y1, better.y1);
+            fragment = w > 0 && h > 0 && w * h >= FRAGMENT_INSIDE_RATIO * area;
+        }
+        if (!fragment)
+            kept.push_back(box);
+    }
+    return kept;
+}
+
+TilePool::TilePool(int num_threads)
+    : stopped(false)
+{
+    for (int i = 0; i < (std::max)(num_threads, 1); i++)
+    {
+        this->workspaces.push_back(std::unique_ptr<DetectionWorkspace>(new DetectionWorkspace()));
+        // the tiles provide the parallelism, one ncnn thread each keeps the cores from being oversubscribed
+        this->workspaces.back()->num_threads = 1;
+    }
+    for (size_t i = 0; i < this->workspaces.size(); i++)
+    {
+        DetectionWorkspace* workspace = this->workspaces[i].get();
+        this->threads.push_back(std::thread([this, workspace]() { this->work(*workspace); }));
+    }
+}
+
+TilePool::~TilePool()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopped = true;
+        this->pending.notify_all();
+    }
+    for (size_t i = 0; i < this->threads.size(); i++)
+        this->threads[i].join();
+}
+
+void TilePool::run(int num_tiles, const std::function<void(int, DetectionWorkspace&)>& job)
+{
+    if (num_tiles <= 0)
+        return;
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+    batch->job = &job;
+    batch->num_tiles = num_tiles;
+    batch->next = 0;
+    batch->remaining = num_tiles;
+
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->batches.push_back(batch);
+    this->pending.notify_all();
+    while (batch->remaining > 0)
+        this->finished.wait(guard);
+}
+
+void TilePool::work(DetectionWorkspace& workspace)
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (true)
+    {
+        // the oldest batch with tiles left, so the frames are finished in the order they came
+        std::shared_ptr<Batch> batch;
+        for (size_t i = 0; i < this->batches.size() && !batch; i++)
+        {
+            if (this->batches[i]->next < this->batches[i]->num_tiles)
+                batch = this->batches[i];
+        }
+        if (!batch)
+        {
+            if (this->stopped)
+                return;
+            this->pending.wait(guard);
+            continue;
+        }
+
+        int tile = batch->next++;
+        if (batch->next == batch->num_tiles)
+            this->batches.erase(std::find(this->batches.begin(), this->batches.end(), batch));
+        guard.unlock();
+        (*batch->job)(tile, workspace);
+        guard.lock();
+        if (--batch->remaining == 0)
+            this->finished.notify_all();
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef TILED_DETECTION_H
+#define TILED_DETECTION_H
+
+#include <opencv2/core/core.hpp>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "nanodet.h"
+
+struct TileConfig
+{
+    int cols = 1; // 1 x 1 for a single letterbox of the whole area
+    int rows = 1;
+    float overlap = 0.2f; // the least fraction of a tile shared with its neighbour, a door on a seam is whole in one of them
+
+    bool enabled() const { return this->cols * this->rows > 1; }
+};
+
+// the cols x rows tiles covering area, neighbours overlapping by at least overlap of a tile. With
+// even the corners are on even pixels, as the chroma of the YUV layouts requires
+std::vector<cv::Rect> tile_grid(const cv::Rect& area, const TileConfig& tiles, bool even = false);
+
+// the boxes of all the tiles, already in frame coordinates, merged into the boxes of the frame: the
+// class-aware NMS and cross-class resolution of a single detection, then the fragments a seam cut
+// off (a box mostly inside a better box of its class) are dropped
+std::vector<BoxInfo> merge_tile_boxes(const std::vector<BoxInfo>& boxes, float score_threshold, float nms_threshold);
+
+// runs the tiles of a frame concurrently on a fixed set of threads, each with its own
+// DetectionWorkspace limited to one ncnn thread, so a tiled frame takes about the time of one
+// inference when there are as many cores as tiles. run() may be called from several threads at once,
+// the tiles of the frame submitted first are handed out first.
+class TilePool
+{
+public:
+    explicit TilePool(int num_threads);
+    ~TilePool();
+
+    // calls job(tile, workspace) for every tile in [0, num_tiles) and returns when all are done
+    void run(int num_tiles, const std::function<void(int, DetectionWorkspace&)>& job);
+
+private:
+    struct Batch
+    {
+        const std::function<void(int, DetectionWorkspace&)>* job;
+        int num_tiles;
+        int next; // the next tile to hand out
+        int remaining; // tiles not finished yet
+    };
+
+    void work(DetectionWorkspace& workspace);
+
+    std::mutex lock;
+    std::condition_variable pending; // a batch has tiles to hand out, or the pool stops
+    std::condition_variable finished; // a batch completed
+    std::vector<std::shared_ptr<Batch> > batches;
+    std::vector<std::unique_ptr<DetectionWorkspace> > workspaces;
+    std::vector<std::thread> threads;
+    bool stopped;
+
+    TilePool(const TilePool&);
+    TilePool& operator=(const TilePool&);
+};
+
+#endif //TILED_DETECTION_H
@@ -0,0 +1,175 @@
+/*
+ * a consumer of the frame bus (frame_bus.h), and the example of reading the frames in place
+ *
+ * Sleeps on the bus, pins the newest frame of every camera which has a new one, prints its metadata
+ * and the time from its publish to the pin, and unpins it. -save DIR also writes every -every N-th
+ * frame of each camera to DIR/camera_<idx>_<timestamp>.ppm, copied out of the slot and checked with
+ * frame_bus_validate, a torn copy is counted and not written. The drops of the writer (all the slots
+ * pinned) and the slots it took back from slow consumers are printed at the end. A writer restart is
+ * followed as in result_reader.
+ */
+
+#define _GNU_SOURCE /* clock_gettime, shm_open and usleep under -std=c99 */
+#include "frame_bus.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int signal_number)
+{
+    (void)signal_number;
+    stopping = 1;
+}
+
+static void print_usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [-name /door_frames] [-save DIR] [-every N] [-quiet]\n", name);
+}
+
+/*
+ * binary PPM of the frame, RGB. The frame is copied out first, the file is written only when
+ * frame_bus_validate finds the copy is of the frame: a slot held past the hold time of the writer may
+ * have been taken back and overwritten during the copy. Returns 1 when written, 0 when the file could
+ * not be written, -1 when the copy was torn.
+ */
+static int save_ppm(FrameBusHeader* bus, const char* path, const FrameBusFrame* frame)
+{
+    const FrameBusSlot* slot = frame->slot;
+    const uint32_t width = slot->width;
+    const uint32_t height = slot->height;
+    const uint32_t stride = slot->stride;
+    if ((size_t)stride * height > bus->frame_bytes || (size_t)width * 3 > stride)
+        return -1;
+    unsigned char* rgb = (unsigned char*)malloc((size_t)width * height * 3);
+    if (rgb == NULL)
+        return 0;
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const uint8_t* bgr = frame->pixels + (size_t)y * stride;
+        unsigned char* row = rgb + (size_t)y * width * 3;
+        for (uint32_t x = 0; x < width; x++)
+        {
+            row[3 * x] = bgr[3 * x + 2];
+            row[3 * x + 1] = bgr[3 * x + 1];
+            row[3 * x + 2] = bgr[3 * x];
+        }
+    }
+    if (!frame_bus_validate(bus, frame))
+    {
+        free(rgb);
+        return -1;
+    }
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        free(rgb);
+        return 0;
+    }
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+    fwrite(rgb, 3, (size_t)width * height, file);
+    free(rgb);
+    fclose(file);
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    const char* name = "/door_frames";
+    const char* save_dir = NULL;
+    int every = 25;
+    int quiet = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-name") && i + 1 < argc)
+            name = argv[++i];
+        else if (!strcmp(argv[i], "-save") && i + 1 < argc)
+            save_dir = argv[++i];
+        else if (!strcmp(argv[i], "-every") && i + 1 < argc)
+            every = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-quiet"))
+            quiet = 1;
+        else
+        {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    if (every < 1)
+        every = 1;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    uint64_t frames = 0;
+    uint64_t latency_sum_ns = 0;
+    uint64_t torn = 0;
+    while (!stopping)
+    {
+        size_t size = 0;
+        FrameBusHeader* bus = frame_bus_map(name, &size);
+        if (bus == NULL)
+        {
+            usleep(20000);
+            continue;
+        }
+        printf("mapped the frame bus, %u slots of %u bytes, writer %u, start %llu\n", bus->slot_count, bus->frame_bytes,
+               bus->writer_pid, (unsigned long long)bus->generation);
+
+        uint64_t seen[FRAME_BUS_MAX_CAMERAS] = {0};
+        uint64_t counts[FRAME_BUS_MAX_CAMERAS] = {0};
+        uint64_t newest = 0;
+        int closed = 0;
+        while (!stopping)
+        {
+            int ready = frame_bus_wait(bus, newest, 500);
+            if (ready < 0)
+            {
+                closed = 1;
+                break;
+            }
+            newest = __atomic_load_n(&bus->sequence, __ATOMIC_ACQUIRE);
+            for (uint32_t camera = 0; camera < bus->cameras; camera++)
+            {
+                FrameBusFrame frame;
+                if (!frame_bus_acquire(bus, camera, &frame))
+                    continue;
+                if (frame.sequence == seen[camera])
+                {
+                    frame_bus_release(bus, &frame);
+                    continue;
+                }
+                const uint64_t latency_ns = frame_bus_now_ns() - frame.slot->publish_ns;
+                const FrameBusSlot* slot = frame.slot;
+                seen[camera] = frame.sequence;
+                frames++;
+                latency_sum_ns += latency_ns;
+                if (!quiet)
+                    printf("camera %d frame %llu at %llu: %ux%u%s, detection %llu%s, pinned %.1fus after the publish\n",
+                           slot->camera_idx, (unsigned long long)frame.sequence, (unsigned long long)slot->timestamp_ms,
+                           slot->width, slot->height, slot->flags & FRAME_BUS_ANNOTATED ? " annotated" : "",
+                           (unsigned long long)slot->detection_sequence, slot->flags & FRAME_BUS_COMPUTED ? " (this frame)" : "",
+                           latency_ns / 1000.0);
+                if (save_dir != NULL && counts[camera]++ % every == 0)
+                {
+                    char path[512];
+                    snprintf(path, sizeof(path), "%s/camera_%d_%llu.ppm", save_dir, slot->camera_idx, (unsigned long long)slot->timestamp_ms);
+                    int saved = save_ppm(bus, path, &frame);
+                    if (saved < 0)
+                        torn++;
+                    else if (saved == 0)
+                        fprintf(stderr, "failed to write %s\n", path);
+                }
+                frame_bus_release(bus, &frame);
+            }
+        }
+        printf("frames:%llu avg pin latency:%.1fus torn copies:%llu | writer published:%llu dropped:%llu reclaimed:%llu\n",
+               (unsigned long long)frames, frames ? latency_sum_ns / 1000.0 / frames : 0.0, (unsigned long long)torn,
+               (unsigned long long)bus->sequence,
+               (unsigned long long)bus->dropped, (unsigned long long)bus->reclaimed);
+        frame_bus_unmap(bus, size);
+        if (closed)
+            printf("the frame bus was replaced, mapping the new one\n");
+    }
+    return 0;
+}
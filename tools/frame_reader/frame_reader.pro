@@ -0,0 +1,16 @@
+# frame bus consumer for the door detector, see frame_reader.c
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle qt
+
+QMAKE_CFLAGS += -std=gnu99
+
+SOURCES += \
+    frame_reader.c
+
+HEADERS += \
+    ../../frame_bus.h
+
+INCLUDEPATH += ../..
+
+LIBS += -lrt
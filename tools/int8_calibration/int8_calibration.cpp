@@ -0,0 +1,632 @@
+//
+// int8 calibration of the door detector, and the fp32/int8 comparison report
+//
+// calibrate: frames sampled from the recorded door videos go through resize_uniform + NanoDet::preprocess
+// exactly as in the detection loops. The table holds the per output channel weight scales and the
+// KL-divergence activation scales of every Convolution/ConvolutionDepthWise layer in the ncnn2table
+// format, the quantized pair is then made with the ncnn tool:
+//     ncnn2int8 nanodet_door.param nanodet_door.bin nanodet_door_int8.param nanodet_door_int8.bin nanodet_door.table
+//
+// compare: runs the fp32 and int8 models side by side on the same frames and reports the latencies and
+// how many detections agree, to decide per site whether int8 is worth it.
+//
+
+#include <nanodet.h>
+#include "letterbox.h"
+#include <opencv2/opencv.hpp>
+#include <benchmark.h>
+#include <layer.h>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#define NUM_HISTOGRAM_BINS 2048
+#define TARGET_BIN 128
+
+static void print_usage(const char* name)
+{
+    fprintf(stderr, "usage: %s calibrate [model.param] [model.bin] [out.table] [video ...] [-every N] [-max M]\n", name);
+    fprintf(stderr, "       %s compare [fp32.param] [fp32.bin] [int8.param] [int8.bin] [video ...] [-every N] [-max M] [-thresh T] [-report out.txt]\n", name);
+}
+
+struct ToolOptions
+{
+    std::vector<std::string> positional;
+    int every = 15; // take one frame out of N
+    int max_frames = 300;
+    float det_threshold = 0.5f;
+    std::string report_path;
+};
+
+static bool parse_options(int argc, char** argv, ToolOptions& options)
+{
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-every") == 0 && i + 1 < argc)
+            options.every = (std::max)(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "-max") == 0 && i + 1 < argc)
+            options.max_frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-thresh") == 0 && i + 1 < argc)
+            options.det_threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "-report") == 0 && i + 1 < argc)
+            options.report_path = argv[++i];
+        else if (argv[i][0] == '-')
+            return false;
+        else
+            options.positional.push_back(argv[i]);
+    }
+    return true;
+}
+
+// letterboxed frames sampled from the videos, as the detection loops feed them to detect()
+static int load_frames(const std::vector<std::string>& videos, const ToolOptions& options, cv::Size size, std::vector<cv::Mat>& frames)
+{
+    for (const auto& path : videos)
+    {
+        cv::VideoCapture cap(path);
+        if (!cap.isOpened())
+        {
+            printf("error: failed to open video %s\n", path.c_str());
+            continue;
+        }
+        cv::Mat image;
+        int frameIndex = -1;
+        while ((int)frames.size() < options.max_frames && cap.read(image))
+        {
+            frameIndex++;
+            if (frameIndex % options.every != 0)
+                continue;
+            object_rect effect_roi;
+            cv::Mat resized_img;
+            resize_uniform(image, resized_img, size, effect_roi);
+            frames.push_back(resized_img);
+        }
+        printf("%s: %d frames sampled so far\n", path.c_str(), (int)frames.size());
+    }
+    return (int)frames.size();
+}
+
+// ---------------------------------------------------------------------------------------------------
+// weights, read straight from the param/bin pair
+
+struct ConvWeights
+{
+    std::string name;
+    int num_output;
+    int group; // 1 for Convolution, the channel groups for ConvolutionDepthWise
+    std::vector<float> weights;
+};
+
+static float half_to_float(unsigned short value)
+{
+    unsigned int sign = (value & 0x8000) << 16;
+    unsigned int exponent = (value & 0x7c00) >> 10;
+    unsigned int mantissa = value & 0x03ff;
+    unsigned int bits;
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            bits = sign;
+        } else
+        {
+            // denormal, renormalize it
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x0400))
+            {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x03ff) << 13);
+        }
+    } else if (exponent == 0x1f)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else
+    {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// one weight blob as ncnn's ModelBin::load(w, 0) stores it: a 4-byte tag then fp32, fp16 or
+// 8-bit table-quantized values
+static bool read_weight_blob(FILE* fp, int size, std::vector<float>& weights)
+{
+    unsigned char tag[4];
+    if (fread(tag, 1, 4, fp) != 4)
+        return false;
+    unsigned int flag;
+    memcpy(&flag, tag, 4);
+
+    weights.resize(size);
+    if (flag == 0x01306B47)
+    {
+        std::vector<unsigned short> halfs((size + 1) / 2 * 2);
+        if (fread(halfs.data(), sizeof(unsigned short), halfs.size(), fp) != halfs.size())
+            return false;
+        for (int i = 0; i < size; i++)
+            weights[i] = half_to_float(halfs[i]);
+        return true;
+    }
+    if (flag == 0x000D4B38)
+    {
+        printf("error: the model is already int8\n");
+        return false;
+    }
+    if (flag == 0x0002C056 || (tag[0] == 0 && tag[1] == 0 && tag[2] == 0 && tag[3] == 0))
+        return fread(weights.data(), sizeof(float), size, fp) == (size_t)size;
+
+    // 256-entry value table followed by the byte indexes, 4-byte aligned
+    float table[256];
+    if (fread(table, sizeof(float), 256, fp) != 256)
+        return false;
+    std::vector<unsigned char> indexes((size + 3) / 4 * 4);
+    if (fread(indexes.data(), 1, indexes.size(), fp) != indexes.size())
+        return false;
+    for (int i = 0; i < size; i++)
+        weights[i] = table[indexes[i]];
+    return true;
+}
+
+// walks the param file and pulls the convolution weights out of the bin in the same order ncnn loads
+// them. The door model only has weights in Convolution and ConvolutionDepthWise layers, any other
+// layer type known to carry weights stops the walk rather than misreading the bin.
+static bool read_conv_weights(const char* param_path, const char* bin_path, std::vector<ConvWeights>& convs)
+{
+    FILE* pp = fopen(param_path, "rb");
+    FILE* bp = fopen(bin_path, "rb");
+    if (!pp || !bp)
+    {
+        printf("error: failed to open %s or %s\n", param_path, bin_path);
+        if (pp) fclose(pp);
+        if (bp) fclose(bp);
+        return false;
+    }
+
+    bool ok = true;
+    int magic = 0, layer_count = 0, blob_count = 0;
+    if (fscanf(pp, "%d", &magic) != 1 || magic != 7767517 || fscanf(pp, "%d %d", &layer_count, &blob_count) != 2)
+    {
+        printf("error: %s is not an ncnn param file\n", param_path);
+        ok = false;
+    }
+
+    static const char* unsupported[] = { "InnerProduct", "Deconvolution", "DeconvolutionDepthWise", "BatchNorm", "Scale", "PReLU", "MemoryData", "Embed" };
+    for (int i = 0; ok && i < layer_count; i++)
+    {
+        char type[256], name[256];
+        int bottom_count = 0, top_count = 0;
+        if (fscanf(pp, "%255s %255s %d %d", type, name, &bottom_count, &top_count) != 4)
+        {
+            ok = false;
+            break;
+        }
+        char blob[256];
+        for (int j = 0; j < bottom_count + top_count; j++)
+            fscanf(pp, "%255s", blob);
+
+        // the rest of the line are the k=v params, arrays (k <= -23300) are skipped
+        char line[4096];
+        if (!fgets(line, sizeof(line), pp))
+            line[0] = '\0';
+        std::map<int, int> params;
+        for (char* token = strtok(line, " \t\r\n"); token; token = strtok(nullptr, " \t\r\n"))
+        {
+            int key = 0;
+            char value[256];
+            if (sscanf(token, "%d=%255s", &key, value) == 2 && key > -23300)
+                params[key] = atoi(value);
+        }
+
+        for (const char* u : unsupported)
+        {
+            if (strcmp(type, u) == 0)
+            {
+                printf("error: layer %s of type %s carries weights this tool does not read\n", name, type);
+                ok = false;
+            }
+        }
+        if (!ok || (strcmp(type, "Convolution") != 0 && strcmp(type, "ConvolutionDepthWise") != 0))
+            continue;
+
+        ConvWeights conv;
+        conv.name = name;
+        conv.num_output = params[0];
+        conv.group = strcmp(type, "ConvolutionDepthWise") == 0 ? (std::max)(1, params[7]) : 1;
+        if (params[8] != 0)
+        {
+            printf("error: layer %s is already quantized\n", name);
+            ok = false;
+            break;
+        }
+        if (!read_weight_blob(bp, params[6], conv.weights))
+        {
+            printf("error: failed to read the weights of %s\n", name);
+            ok = false;
+            break;
+        }
+        if (params[5])
+        {
+            // the bias is stored raw, it is not quantized
+            if (fseek(bp, (long)conv.num_output * sizeof(float), SEEK_CUR) != 0)
+                ok = false;
+        }
+        convs.push_back(conv);
+    }
+
+    fclose(pp);
+    fclose(bp);
+    return ok;
+}
+
+// 127 / absmax per output channel, per group for depthwise
+static std::vector<float> weight_scales(const ConvWeights& conv)
+{
+    const int channels = conv.group > 1 ? conv.group : conv.num_output;
+    const int per_channel = (int)conv.weights.size() / channels;
+    std::vector<float> scales(channels);
+    for (int c = 0; c < channels; c++)
+    {
+        float absmax = 0.f;
+        for (int k = 0; k < per_channel; k++)
+            absmax = (std::max)(absmax, std::fabs(conv.weights[c * per_channel + k]));
+        scales[c] = absmax == 0.f ? 1.f : 127.f / absmax;
+    }
+    return scales;
+}
+
+// ---------------------------------------------------------------------------------------------------
+// activations, KL-divergence calibration as in ncnn2table
+
+static float kl_divergence(const std::vector<float>& p, const std::vector<float>& q)
+{
+    float result = 0.f;
+    for (size_t i = 0; i < p.size(); i++)
+    {
+        if (p[i] == 0.f)
+            continue;
+        result += p[i] * std::log(p[i] / (std::max)(q[i], 1e-12f));
+    }
+    return result;
+}
+
+// the histogram bin where clipping loses the least information when squeezed into TARGET_BIN levels
+static int threshold_distribution(const std::vector<float>& distribution)
+{
+    const int length = (int)distribution.size();
+    int target_threshold = TARGET_BIN;
+    float min_divergence = FLT_MAX;
+
+    float outliers = 0.f;
+    for (int t = TARGET_BIN; t < length; t++)
+        outliers += distribution[t];
+
+    std::vector<float> quantized(TARGET_BIN);
+    for (int threshold = TARGET_BIN; threshold < length; threshold++)
+    {
+        // P: the histogram clipped at threshold, the clipped mass folded into the last bin
+        std::vector<float> clipped(distribution.begin(), distribution.begin() + threshold);
+        clipped[threshold - 1] += outliers;
+        outliers -= distribution[threshold];
+
+        // Q: P merged into TARGET_BIN levels, then spread back over the non-empty bins
+        const float bins_per_level = (float)threshold / TARGET_BIN;
+        std::fill(quantized.begin(), quantized.end(), 0.f);
+        std::vector<float> expanded(threshold, 0.f);
+        for (int i = 0; i < TARGET_BIN; i++)
+        {
+            const float start = i * bins_per_level;
+            const float end = start + bins_per_level;
+            const int left_upper = (int)std::ceil(start);
+            const int right_lower = (int)std::floor(end);
+            const float left_scale = left_upper - start;
+            const float right_scale = end - right_lower;
+
+            float count = 0.f;
+            if (left_upper > start)
+            {
+                quantized[i] += left_scale * distribution[left_upper - 1];
+                if (distribution[left_upper - 1] != 0.f)
+                    count += left_scale;
+            }
+            if (right_lower < end)
+            {
+                quantized[i] += right_scale * distribution[right_lower];
+                if (distribution[right_lower] != 0.f)
+                    count += right_scale;
+            }
+            for (int j = left_upper; j < right_lower; j++)
+            {
+                quantized[i] += distribution[j];
+                if (distribution[j] != 0.f)
+                    count += 1.f;
+            }
+
+            if (count == 0.f)
+                continue;
+            const float value = quantized[i] / count;
+            if (left_upper > start && distribution[left_upper - 1] != 0.f)
+                expanded[left_upper - 1] += value * left_scale;
+            if (right_lower < end && distribution[right_lower] != 0.f)
+                expanded[right_lower] += value * right_scale;
+            for (int j = left_upper; j < right_lower; j++)
+            {
+                if (distribution[j] != 0.f)
+                    expanded[j] += value;
+            }
+        }
+
+        float divergence = kl_divergence(clipped, expanded);
+        if (divergence < min_divergence)
+        {
+            min_divergence = divergence;
+            target_threshold = threshold;
+        }
+    }
+    return target_threshold;
+}
+
+static int calibrate(const ToolOptions& options)
+{
+    if (options.positional.size() < 4)
+        return -1;
+    const char* param_path = options.positional[0].c_str();
+    const char* bin_path = options.positional[1].c_str();
+    const char* table_path = options.positional[2].c_str();
+    std::vector<std::string> videos(options.positional.begin() + 3, options.positional.end());
+
+    std::vector<ConvWeights> convs;
+    if (!read_conv_weights(param_path, bin_path, convs))
+        return -1;
+
+    // calibrate on plain fp32 blobs, no fp16 rounding or packing in the statistics
+    ExecutionProfile profile;
+    profile.use_packing_layout = false;
+    profile.use_fp16_packed = false;
+    profile.use_fp16_storage = false;
+    profile.use_fp16_arithmetic = false;
+    NanoDet detector(param_path, bin_path, false, profile);
+
+    std::vector<cv::Mat> frames;
+    if (load_frames(videos, options, cv::Size(detector.input_size[1], detector.input_size[0]), frames) == 0)
+    {
+        printf("error: no calibration frames\n");
+        return -1;
+    }
+
+    // the blob each quantized layer reads
+    std::map<std::string, int> layer_index;
+    const std::vector<ncnn::Layer*>& layers = detector.net().layers();
+    for (int i = 0; i < (int)layers.size(); i++)
+        layer_index[layers[i]->name] = i;
+    std::vector<int> bottoms(convs.size());
+    for (size_t k = 0; k < convs.size(); k++)
+        bottoms[k] = layers[layer_index[convs[k].name]]->bottoms[0];
+
+    // two passes over the frames: the absmax of every blob, then its histogram over [0, absmax]
+    std::vector<float> absmax(convs.size(), 0.f);
+    std::vector<std::vector<float> > histograms(convs.size(), std::vector<float>(NUM_HISTOGRAM_BINS, 0.f));
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (size_t f = 0; f < frames.size(); f++)
+        {
+            ncnn::Mat in;
+            detector.preprocess(frames[f], in);
+            ncnn::Extractor ex = detector.net().create_extractor();
+            // every bottom blob stays around, they are extracted one after the other
+            ex.set_light_mode(false);
+            ex.input("data", in);
+            for (size_t k = 0; k < convs.size(); k++)
+            {
+                ncnn::Mat blob;
+                ex.extract(bottoms[k], blob);
+                const float bin_width = absmax[k] / NUM_HISTOGRAM_BINS;
+                for (int q = 0; q < blob.c; q++)
+                {
+                    const float* ptr = blob.channel(q);
+                    const int size = blob.w * blob.h * blob.d;
+                    for (int i = 0; i < size; i++)
+                    {
+                        const float v = std::fabs(ptr[i]);
+                        if (pass == 0)
+                        {
+                            absmax[k] = (std::max)(absmax[k], v);
+                        } else if (v != 0.f && bin_width > 0.f)
+                        {
+                            int index = (std::min)((int)(v / bin_width), NUM_HISTOGRAM_BINS - 1);
+                            histograms[k][index] += 1.f;
+                        }
+                    }
+                }
+            }
+        }
+        printf("calibration pass %d done\n", pass + 1);
+    }
+
+    FILE* fp = fopen(table_path, "wb");
+    if (!fp)
+    {
+        printf("error: failed to create %s\n", table_path);
+        return -1;
+    }
+    for (const auto& conv : convs)
+    {
+        fprintf(fp, "%s_param_0", conv.name.c_str());
+        for (float scale : weight_scales(conv))
+            fprintf(fp, " %f", scale);
+        fprintf(fp, "\n");
+    }
+    for (size_t k = 0; k < convs.size(); k++)
+    {
+        std::vector<float>& histogram = histograms[k];
+        float sum = 0.f;
+        for (float v : histogram)
+            sum += v;
+        float scale = 1.f;
+        if (sum > 0.f && absmax[k] > 0.f)
+        {
+            for (float& v : histogram)
+                v /= sum;
+            const int threshold_bin = threshold_distribution(histogram);
+            const float threshold = (threshold_bin + 0.5f) * absmax[k] / NUM_HISTOGRAM_BINS;
+            scale = 127.f / threshold;
+        }
+        fprintf(fp, "%s %f\n", convs[k].name.c_str(), scale);
+    }
+    fclose(fp);
+
+    printf("%d layers calibrated on %d frames, table written to %s\n", (int)convs.size(), (int)frames.size(), table_path);
+    printf("next: ncnn2int8 %s %s <int8.param> <int8.bin> %s\n", param_path, bin_path, table_path);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------------------------------
+// fp32 vs int8 report
+
+static float box_iou(const BoxInfo& a, const BoxInfo& b)
+{
+    float w = (std::min)(a.x2, b.x2) - (std::max)(a.x1, b.x1);
+    float h = (std::min)(a.y2, b.y2) - (std::max)(a.y1, b.y1);
+    if (w <= 0.f || h <= 0.f)
+        return 0.f;
+    float inter = w * h;
+    return inter / ((a.x2 - a.x1) * (a.y2 - a.y1) + (b.x2 - b.x1) * (b.y2 - b.y1) - inter);
+}
+
+// int8 boxes matched greedily to fp32 boxes of the same label with IoU >= 0.5
+static int count_matches(const std::vector<BoxInfo>& reference, const std::vector<BoxInfo>& candidate)
+{
+    std::vector<bool> used(reference.size(), false);
+    int matches = 0;
+    for (const auto& box : candidate)
+    {
+        int best = -1;
+        float best_iou = 0.5f;
+        for (size_t i = 0; i < reference.size(); i++)
+        {
+            if (used[i] || reference[i].label != box.label)
+                continue;
+            float iou = box_iou(reference[i], box);
+            if (iou >= best_iou)
+            {
+                best_iou = iou;
+                best = (int)i;
+            }
+        }
+        if (best >= 0)
+        {
+            used[best] = true;
+            matches++;
+        }
+    }
+    return matches;
+}
+
+static bool any_open(const std::vector<BoxInfo>& boxes)
+{
+    for (const auto& box : boxes)
+    {
+        if (box.label > 0)
+            return true;
+    }
+    return false;
+}
+
+static int compare(const ToolOptions& options)
+{
+    if (options.positional.size() < 5)
+        return -1;
+    std::vector<std::string> videos(options.positional.begin() + 4, options.positional.end());
+
+    NanoDet fp32(options.positional[0].c_str(), options.positional[1].c_str(), false);
+    NanoDet int8(options.positional[2].c_str(), options.positional[3].c_str(), false);
+
+    std::vector<cv::Mat> frames;
+    if (load_frames(videos, options, cv::Size(fp32.input_size[1], fp32.input_size[0]), frames) == 0)
+    {
+        printf("error: no frames to compare on\n");
+        return -1;
+    }
+
+    // the first frames warm the pools and caches up and are left out of the timings
+    const int warmup = (std::min)(3, (int)frames.size() - 1);
+    double fp32_ms = 0, int8_ms = 0;
+    int fp32_boxes = 0, int8_boxes = 0, matched = 0, same_state = 0;
+    for (size_t f = 0; f < frames.size(); f++)
+    {
+        double start = ncnn::get_current_time();
+        std::vector<BoxInfo> fp32_results = fp32.detect(frames[f], options.det_threshold, 0.5f);
+        double middle = ncnn::get_current_time();
+        std::vector<BoxInfo> int8_results = int8.detect(frames[f], options.det_threshold, 0.5f);
+        double end = ncnn::get_current_time();
+        if ((int)f >= warmup)
+        {
+            fp32_ms += middle - start;
+            int8_ms += end - middle;
+        }
+
+        fp32_boxes += (int)fp32_results.size();
+        int8_boxes += (int)int8_results.size();
+        matched += count_matches(fp32_results, int8_results);
+        if (any_open(fp32_results) == any_open(int8_results))
+            same_state++;
+    }
+
+    const int timed = (int)frames.size() - warmup;
+    char report[2048];
+    snprintf(report, sizeof(report),
+             "frames: %d (every %d-th frame, det_threshold %.2f)\n"
+             "latency fp32: %.2f ms/frame\n"
+             "latency int8: %.2f ms/frame\n"
+             "speedup: %.2fx\n"
+             "detections fp32: %d, int8: %d, matched (same label, IoU >= 0.5): %d\n"
+             "int8 recall vs fp32: %.1f%%, precision vs fp32: %.1f%%\n"
+             "frames with the same door-open state: %.1f%%\n",
+             (int)frames.size(), options.every, options.det_threshold,
+             fp32_ms / timed, int8_ms / timed, int8_ms > 0 ? fp32_ms / int8_ms : 0.0,
+             fp32_boxes, int8_boxes, matched,
+             fp32_boxes ? 100.f * matched / fp32_boxes : 100.f, int8_boxes ? 100.f * matched / int8_boxes : 100.f,
+             100.f * same_state / frames.size());
+    printf("%s", report);
+
+    if (!options.report_path.empty())
+    {
+        FILE* fp = fopen(options.report_path.c_str(), "wb");
+        if (!fp)
+        {
+            printf("error: failed to create %s\n", options.report_path.c_str());
+            return -1;
+        }
+        fputs(report, fp);
+        fclose(fp);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    ToolOptions options;
+    if (argc < 2 || !parse_options(argc, argv, options))
+    {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    int ret = -1;
+    if (strcmp(argv[1], "calibrate") == 0)
+        ret = calibrate(options);
+    else if (strcmp(argv[1], "compare") == 0)
+        ret = compare(options);
+
+    if (ret != 0 && options.positional.size() < 4)
+        print_usage(argv[0]);
+    return ret;
+}
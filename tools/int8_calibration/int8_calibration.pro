@@ -0,0 +1,34 @@
+# int8 calibration table writer and fp32/int8 comparison for the door detector, see int8_calibration.cpp
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle qt
+
+QMAKE_LFLAGS += -fopenmp
+QMAKE_CXXFLAGS+= -fopenmp
+
+SOURCES += \
+    int8_calibration.cpp \
+    ../../inference_context.cpp \
+    ../../letterbox.cpp \
+    ../../nanodet.cpp \
+    ../../nanodet_kernels.cpp \
+    ../../nms.cpp
+
+HEADERS += \
+    ../../inference_context.h \
+    ../../letterbox.h \
+    ../../nanodet.h \
+    ../../nanodet_kernels.h \
+    ../../nms.h
+
+INCLUDEPATH += ../.. \
+               /usr/local/include/ \
+               /usr/local/include/opencv \
+               /usr/local/include/opencv2 \
+               /usr/local/include/ncnn/include
+
+LIBS += /usr/local/lib/libopencv_imgproc.so \
+        /usr/local/lib/libopencv_core.so \
+        /usr/local/lib/libopencv_imgcodecs.so \
+        /usr/local/lib/libopencv_videoio.so \
+        /usr/local/lib/libncnn.a
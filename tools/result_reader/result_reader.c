@@ -0,0 +1,208 @@
+/*
+ * a consumer of the detector results, and the measure of the shared memory transport
+ *
+ * Maps the ring (result_ring.h) of the posix transport by name, or of the sysv transport by key,
+ * sleeps on its futex and prints every message: the binary records (door_results.h) decoded, the JSON
+ * ones as they are. Every message gives a wake-up latency, the time from its publish to this reader
+ * having it; the statistics, the messages lost to overruns and the system calls the writer made per
+ * publish are printed every -stats N messages and at the end.
+ *
+ * A writer restart is followed without doing anything: the same ring goes on, or the replaced one is
+ * closed and the reader maps the new one.
+ */
+
+#define _GNU_SOURCE /* clock_gettime, shm_open and usleep under -std=c99 */
+#include "result_ring.h"
+#include "door_results.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#define LATENCY_BINS 4096 /* microseconds, the last bin holds everything slower */
+
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int signal_number)
+{
+    (void)signal_number;
+    stopping = 1;
+}
+
+static void print_usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [-name /door_results | -key 1243] [-stats N] [-quiet]\n", name);
+}
+
+struct LatencyStats
+{
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t bins[LATENCY_BINS];
+};
+
+static void add_latency(struct LatencyStats* stats, uint64_t latency_ns)
+{
+    uint64_t bin = latency_ns / 1000;
+    stats->bins[bin < LATENCY_BINS ? bin : LATENCY_BINS - 1]++;
+    stats->count++;
+    stats->sum_ns += latency_ns;
+    if (latency_ns > stats->max_ns)
+        stats->max_ns = latency_ns;
+}
+
+/* the latency below which fraction of the messages were woken, in microseconds */
+static int latency_percentile(const struct LatencyStats* stats, double fraction)
+{
+    if (stats->count == 0)
+        return 0;
+    uint64_t wanted = (uint64_t)(fraction * stats->count);
+    uint64_t seen = 0;
+    for (int bin = 0; bin < LATENCY_BINS; bin++)
+    {
+        seen += stats->bins[bin];
+        if (seen > wanted)
+            return bin + 1;
+    }
+    return LATENCY_BINS;
+}
+
+static void print_stats(ResultRingHeader* ring, int reader, const struct LatencyStats* stats, uint64_t published_start, uint64_t wakeups_start)
+{
+    uint64_t published = ring->head - published_start;
+    uint64_t wakeups = ring->wakeups - wakeups_start;
+    printf("messages:%llu wake-up latency avg:%.1fus p50:<%dus p99:<%dus max:%.1fus | overruns:%llu | writer futex wake-ups:%llu for %llu publishes (%.3f system calls per publish) start:%llu\n",
+           (unsigned long long)stats->count, stats->count ? stats->sum_ns / 1000.0 / stats->count : 0.0,
+           latency_percentile(stats, 0.5), latency_percentile(stats, 0.99), stats->max_ns / 1000.0,
+           (unsigned long long)(reader >= 0 ? ring->readers[reader].overruns : 0), (unsigned long long)wakeups,
+           (unsigned long long)published, published ? (double)wakeups / published : 0.0, (unsigned long long)ring->generation);
+}
+
+static void print_message(const char* message, uint32_t length)
+{
+    const DoorResultRecord* record;
+    const DoorResultEntry* doors;
+    if (!door_results_view(message, length, &record, &doors))
+    {
+        printf("%.*s\n", (int)length, message);
+        return;
+    }
+    static const char* kinds[] = {"frame", "transition", "heartbeat"};
+    printf("camera %d at %llu: %s, %u doors%s\n", record->camera_idx, (unsigned long long)record->timestamp_ms,
+           record->kind < 3 ? kinds[record->kind] : "?", record->door_count, record->flags & DOOR_RESULTS_ANY_OPEN ? ", open" : "");
+    for (uint32_t i = 0; i < record->door_count; i++)
+    {
+        const DoorResultEntry* door = &doors[i];
+        printf("    door %d track %d: %d", door->door_id, door->track_id, door->status);
+        if (door->flags & DOOR_ENTRY_TRANSITION)
+            printf(" (was %d)", door->previous_status);
+        printf(" %.2f at %.0f,%.0f %.0fx%.0f\n", door->confidence, door->x, door->y, door->width, door->height);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* name = "/door_results";
+    int key = -1;
+    int stats_every = 100;
+    int quiet = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-name") && i + 1 < argc)
+            name = argv[++i];
+        else if (!strcmp(argv[i], "-key") && i + 1 < argc)
+            key = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-stats") && i + 1 < argc)
+            stats_every = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-quiet"))
+            quiet = 1;
+        else
+        {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    static struct LatencyStats stats;
+    char* message = NULL;
+    uint32_t capacity = 0;
+    int replaced = 0;
+    while (!stopping)
+    {
+        /* (re)map the ring, waiting for the writer to create it */
+        ResultRingHeader* ring = NULL;
+        size_t size = 0;
+        if (key >= 0)
+        {
+            int id = shmget(key, 0, 0666);
+            void* memory = id == -1 ? (void*)-1 : shmat(id, NULL, 0);
+            if (memory != (void*)-1 && result_ring_ready((ResultRingHeader*)memory) && !((ResultRingHeader*)memory)->closed)
+                ring = (ResultRingHeader*)memory;
+            else if (memory != (void*)-1)
+                shmdt(memory);
+        } else
+        {
+            ring = result_ring_map(name, &size);
+        }
+        if (ring == NULL)
+        {
+            usleep(20000);
+            continue;
+        }
+        if (capacity < ring->slot_size)
+        {
+            capacity = ring->slot_size;
+            message = (char*)realloc(message, capacity);
+        }
+
+        uint64_t cursor;
+        int reader = result_ring_attach(ring, &cursor);
+        if (reader < 0)
+        {
+            fprintf(stderr, "all the reader entries are taken, the overruns are not counted\n");
+            cursor = ring->head + 1;
+        }
+        /* the ring replacing a closed one is read from its first message, the writer may be ahead already */
+        if (replaced)
+            result_ring_seek(ring, reader, &cursor, 1);
+        const uint64_t published_start = ring->head;
+        const uint64_t wakeups_start = ring->wakeups;
+        printf("attached to the ring, %u slots of %u bytes, writer %u, start %llu\n", ring->slot_count, ring->slot_size,
+               ring->writer_pid, (unsigned long long)ring->generation);
+
+        int closed = 0;
+        while (!stopping && !closed)
+        {
+            int ready = result_ring_wait(ring, reader, cursor, 500);
+            if (ready < 0)
+            {
+                closed = 1;
+                break;
+            }
+            uint32_t length;
+            uint64_t publish_ns;
+            while (result_ring_read_timed(ring, reader, &cursor, message, capacity, &length, &publish_ns) == 1)
+            {
+                add_latency(&stats, result_ring_now_ns() - publish_ns);
+                if (!quiet)
+                    print_message(message, length);
+                if (stats_every > 0 && stats.count % stats_every == 0)
+                    print_stats(ring, reader, &stats, published_start, wakeups_start);
+            }
+        }
+        print_stats(ring, reader, &stats, published_start, wakeups_start);
+        result_ring_detach(ring, reader);
+        if (key >= 0)
+            shmdt(ring);
+        else
+            result_ring_unmap(ring, size);
+        replaced = closed;
+        if (closed)
+            printf("the ring was replaced, mapping the new one\n");
+    }
+    free(message);
+    return 0;
+}
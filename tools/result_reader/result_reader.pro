@@ -0,0 +1,17 @@
+# shared memory result consumer and wake-up latency measure for the door detector, see result_reader.c
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle qt
+
+QMAKE_CFLAGS += -std=gnu99
+
+SOURCES += \
+    result_reader.c
+
+HEADERS += \
+    ../../door_results.h \
+    ../../result_ring.h
+
+INCLUDEPATH += ../..
+
+LIBS += -lrt
@@ -0,0 +1,466 @@
+#include "v4l2_capture.h"
+#include <opencv2/opencv.hpp>
+#include <linux/videodev2.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+
+// one device served by the epoll loop: its fd becomes readable when a frame is ready
+class FrameSource
+{
+public:
+    FrameSource() : fd(-1), ended(false) {}
+    virtual ~FrameSource() {}
+
+    virtual bool open(const V4l2CameraConfig& config) = 0;
+    // takes the next ready frame, false if none is ready (or the source ended)
+    virtual bool dequeue(RawFrame& frame, std::shared_ptr<FrameSource> self) = 0;
+    // the buffer of a released frame is free again
+    virtual void requeue(int index) = 0;
+
+    int fd;
+    bool ended;
+};
+
+// gives the buffer back once the last frame referencing it is gone, and keeps the mapping alive until then
+struct BufferLease
+{
+    BufferLease(std::shared_ptr<FrameSource> source, int index) : source(source), index(index) {}
+    ~BufferLease() { this->source->requeue(this->index); }
+
+    std::shared_ptr<FrameSource> source;
+    int index;
+};
+
+static int xioctl(int fd, unsigned long request, void* arg)
+{
+    int ret;
+    do {
+        ret = ioctl(fd, request, arg);
+    } while (ret == -1 && errno == EINTR);
+    return ret;
+}
+
+static bool is_planar_420(uint32_t fourcc)
+{
+    return fourcc == V4L2_PIX_FMT_NV12 || fourcc == V4L2_PIX_FMT_YUV420;
+}
+
+static bool is_supported(uint32_t fourcc)
+{
+    return fourcc == V4L2_PIX_FMT_YUYV || fourcc == V4L2_PIX_FMT_MJPEG || is_planar_420(fourcc);
+}
+
+// bytes of one raw frame, 0 for the compressed formats
+static size_t raw_frame_size(uint32_t fourcc, int width, int height)
+{
+    if (fourcc == V4L2_PIX_FMT_YUYV)
+        return (size_t)width * height * 2;
+    if (is_planar_420(fourcc))
+        return (size_t)width * height * 3 / 2;
+    return 0;
+}
+
+static void wrap_buffer(RawFrame& frame, unsigned char* data, size_t size, int stride)
+{
+    if (frame.fourcc == V4L2_PIX_FMT_MJPEG)
+        frame.data = cv::Mat(1, (int)size, CV_8UC1, data);
+    else if (is_planar_420(frame.fourcc))
+        frame.data = cv::Mat(frame.height * 3 / 2, frame.width, CV_8UC1, data, stride);
+    else
+        frame.data = cv::Mat(frame.height, frame.width, CV_8UC2, data, stride);
+}
+
+// a V4L2 capture node in mmap streaming mode
+class V4l2MmapSource : public FrameSource
+{
+public:
+    V4l2MmapSource() : width(0), height(0), stride(0), fourcc(0), streaming(false) {}
+
+    ~V4l2MmapSource()
+    {
+        if (this->streaming)
+        {
+            int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            xioctl(this->fd, VIDIOC_STREAMOFF, &type);
+        }
+        for (size_t i = 0; i < this->buffers.size(); i++)
+            munmap(this->buffers[i].start, this->buffers[i].length);
+        if (this->fd >= 0)
+            close(this->fd);
+    }
+
+    bool open(const V4l2CameraConfig& config)
+    {
+        this->device = config.device;
+        this->fd = ::open(config.device.c_str(), O_RDWR | O_NONBLOCK);
+        if (this->fd < 0)
+        {
+            printf("error: failed to open %s: %s \n", config.device.c_str(), strerror(errno));
+            return false;
+        }
+
+        struct v4l2_capability cap;
+        memset(&cap, 0, sizeof(cap));
+        if (xioctl(this->fd, VIDIOC_QUERYCAP, &cap) < 0 || !(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(cap.capabilities & V4L2_CAP_STREAMING))
+        {
+            printf("error: %s is no streaming capture device \n", config.device.c_str());
+            return false;
+        }
+
+        struct v4l2_format fmt;
+        memset(&fmt, 0, sizeof(fmt));
+        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        fmt.fmt.pix.width = config.width;
+        fmt.fmt.pix.height = config.height;
+        fmt.fmt.pix.pixelformat = fourcc_from_string(config.pixel_format);
+        fmt.fmt.pix.field = V4L2_FIELD_ANY;
+        if (xioctl(this->fd, VIDIOC_S_FMT, &fmt) < 0)
+        {
+            printf("error: %s refused the format %s %dx%d: %s \n", config.device.c_str(), config.pixel_format.c_str(), config.width, config.height, strerror(errno));
+            return false;
+        }
+        // the driver picks the closest size it supports
+        this->width = fmt.fmt.pix.width;
+        this->height = fmt.fmt.pix.height;
+        this->stride = fmt.fmt.pix.bytesperline;
+        this->fourcc = fmt.fmt.pix.pixelformat;
+        if (!is_supported(this->fourcc))
+        {
+            printf("error: %s does not deliver %s \n", config.device.c_str(), config.pixel_format.c_str());
+            return false;
+        }
+
+        struct v4l2_streamparm parm;
+        memset(&parm, 0, sizeof(parm));
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        parm.parm.capture.timeperframe.numerator = 1;
+        parm.parm.capture.timeperframe.denominator = config.fps;
+        // not every driver lets the frame rate be set, the default one is fine then
+        xioctl(this->fd, VIDIOC_S_PARM, &parm);
+
+        struct v4l2_requestbuffers req;
+        memset(&req, 0, sizeof(req));
+        req.count = config.buffers;
+        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        req.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(this->fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2)
+        {
+            printf("error: %s has no mmap buffers: %s \n", config.device.c_str(), strerror(errno));
+            return false;
+        }
+
+        for (unsigned int i = 0; i < req.count; i++)
+        {
+            struct v4l2_buffer buf;
+            memset(&buf, 0, sizeof(buf));
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = V4L2_MEMORY_MMAP;
+            buf.index = i;
+            if (xioctl(this->fd, VIDIOC_QUERYBUF, &buf) < 0)
+                return false;
+            Buffer mapped;
+            mapped.length = buf.length;
+            mapped.start = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, buf.m.offset);
+            if (mapped.start == MAP_FAILED)
+            {
+                printf("error: failed to map the buffer %u of %s \n", i, config.device.c_str());
+                return false;
+            }
+            this->buffers.push_back(mapped);
+            this->requeue(i);
+        }
+
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (xioctl(this->fd, VIDIOC_STREAMON, &type) < 0)
+        {
+            printf("error: failed to start streaming %s: %s \n", config.device.c_str(), strerror(errno));
+            return false;
+        }
+        this->streaming = true;
+        printf("%s streaming %dx%d %.4s with %d mmap buffers \n", config.device.c_str(), this->width, this->height,
+               (const char*)&this->fourcc, (int)this->buffers.size());
+        return true;
+    }
+
+    bool dequeue(RawFrame& frame, std::shared_ptr<FrameSource> self)
+    {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(this->fd, VIDIOC_DQBUF, &buf) < 0)
+        {
+            if (errno != EAGAIN)
+            {
+                printf("error: %s stopped delivering frames: %s \n", this->device.c_str(), strerror(errno));
+                this->ended = true;
+            }
+            return false;
+        }
+        frame.fourcc = this->fourcc;
+        frame.width = this->width;
+        frame.height = this->height;
+        frame.sequence = buf.sequence;
+        wrap_buffer(frame, (unsigned char*)this->buffers[buf.index].start, buf.bytesused, this->stride);
+        frame.lease = std::make_shared<BufferLease>(self, (int)buf.index);
+        return true;
+    }
+
+    void requeue(int index)
+    {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = index;
+        xioctl(this->fd, VIDIOC_QBUF, &buf);
+    }
+
+private:
+    struct Buffer
+    {
+        void* start;
+        size_t length;
+    };
+
+    std::string device;
+    std::vector<Buffer> buffers;
+    int width;
+    int height;
+    int stride;
+    uint32_t fourcc;
+    bool streaming;
+};
+
+// a file of raw YUYV, NV12 or YU12 frames standing in for a camera: mapped once, a timerfd ticking
+// at the frame rate makes it readable, and every tick hands out the next frame in place
+class RawFileSource : public FrameSource
+{
+public:
+    RawFileSource() : data(nullptr), size(0), frame_size(0), next_frame(0), loop(false), width(0), height(0), fourcc(0), file_fd(-1) {}
+
+    ~RawFileSource()
+    {
+        if (this->data)
+            munmap(this->data, this->size);
+        if (this->file_fd >= 0)
+            close(this->file_fd);
+        if (this->fd >= 0)
+            close(this->fd);
+    }
+
+    bool open(const V4l2CameraConfig& config)
+    {
+        this->fourcc = fourcc_from_string(config.pixel_format);
+        this->width = config.width;
+        this->height = config.height;
+        this->frame_size = raw_frame_size(this->fourcc, config.width, config.height);
+        if (this->frame_size == 0)
+        {
+            printf("error: the file stand-in %s only plays YUYV, NV12 or YU12 \n", config.device.c_str());
+            return false;
+        }
+        this->loop = config.loop;
+
+        this->file_fd = ::open(config.device.c_str(), O_RDONLY);
+        struct stat st;
+        if (this->file_fd < 0 || fstat(this->file_fd, &st) < 0 || (size_t)st.st_size < this->frame_size)
+        {
+            printf("error: %s holds no %dx%d %s frame \n", config.device.c_str(), config.width, config.height, config.pixel_format.c_str());
+            return false;
+        }
+        this->size = st.st_size;
+        this->data = (unsigned char*)mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, this->file_fd, 0);
+        if (this->data == MAP_FAILED)
+        {
+            this->data = nullptr;
+            printf("error: failed to map %s \n", config.device.c_str());
+            return false;
+        }
+
+        this->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct itimerspec period;
+        memset(&period, 0, sizeof(period));
+        long interval_ns = 1000000000L / (config.fps > 0 ? config.fps : 30);
+        period.it_interval.tv_nsec = interval_ns;
+        period.it_value.tv_nsec = interval_ns;
+        if (this->fd < 0 || timerfd_settime(this->fd, 0, &period, nullptr) < 0)
+        {
+            printf("error: failed to start the frame timer of %s \n", config.device.c_str());
+            return false;
+        }
+        printf("%s playing %d %dx%d %s frames at %d fps \n", config.device.c_str(), (int)(this->size / this->frame_size),
+               this->width, this->height, config.pixel_format.c_str(), config.fps);
+        return true;
+    }
+
+    bool dequeue(RawFrame& frame, std::shared_ptr<FrameSource> self)
+    {
+        uint64_t ticks = 0;
+        if (read(this->fd, &ticks, sizeof(ticks)) != sizeof(ticks))
+            return false;
+        const size_t num_frames = this->size / this->frame_size;
+        if (this->next_frame >= num_frames)
+        {
+            if (!this->loop)
+            {
+                this->ended = true;
+                return false;
+            }
+            this->next_frame = 0;
+        }
+        frame.fourcc = this->fourcc;
+        frame.width = this->width;
+        frame.height = this->height;
+        frame.sequence = (uint32_t)this->next_frame;
+        wrap_buffer(frame, this->data + this->next_frame * this->frame_size, this->frame_size,
+                    this->fourcc == V4L2_PIX_FMT_YUYV ? this->width * 2 : this->width);
+        frame.lease = std::make_shared<BufferLease>(self, (int)this->next_frame);
+        this->next_frame++;
+        return true;
+    }
+
+    void requeue(int)
+    {
+        // the mapping stays valid until the source is destroyed
+    }
+
+private:
+    unsigned char* data;
+    size_t size;
+    size_t frame_size;
+    size_t next_frame;
+    bool loop;
+    int width;
+    int height;
+    uint32_t fourcc;
+    int file_fd;
+};
+
+uint32_t fourcc_from_string(const std::string& name)
+{
+    if (name.size() != 4)
+        return 0;
+    return v4l2_fourcc(name[0], name[1], name[2], name[3]);
+}
+
+V4l2Capture::V4l2Capture()
+    : epoll_fd(epoll_create1(EPOLL_CLOEXEC)), active(0)
+{
+}
+
+V4l2Capture::~V4l2Capture()
+{
+    // the sources themselves stay alive while frames still hold a lease on their buffers
+    this->sources.clear();
+    if (this->epoll_fd >= 0)
+        close(this->epoll_fd);
+}
+
+int V4l2Capture::add_device(const V4l2CameraConfig& config)
+{
+    struct stat st;
+    std::shared_ptr<FrameSource> source;
+    if (stat(config.device.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        source.reset(new RawFileSource());
+    else
+        source.reset(new V4l2MmapSource());
+    if (!source->open(config))
+        return -1;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = (uint32_t)this->sources.size();
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, source->fd, &event) < 0)
+    {
+        printf("error: failed to watch %s: %s \n", config.device.c_str(), strerror(errno));
+        return -1;
+    }
+    this->sources.push_back(source);
+    this->active++;
+    return (int)this->sources.size() - 1;
+}
+
+bool V4l2Capture::wait_frames(std::vector<RawFrame>& frames, int timeout_ms)
+{
+    frames.clear();
+    if (this->active == 0)
+        return false;
+
+    struct epoll_event events[16];
+    int ready = epoll_wait(this->epoll_fd, events, 16, timeout_ms);
+    if (ready < 0 && errno != EINTR)
+    {
+        printf("error: epoll_wait failed: %s \n", strerror(errno));
+        return false;
+    }
+
+    for (int e = 0; e < ready; e++)
+    {
+        const int index = (int)events[e].data.u32;
+        std::shared_ptr<FrameSource>& source = this->sources[index];
+        // drain the device, only its newest frame is handed out, the older ones go straight back
+        RawFrame newest;
+        RawFrame frame;
+        while (source->dequeue(frame, source))
+        {
+            newest = frame;
+            frame = RawFrame();
+        }
+        if (!newest.empty())
+        {
+            newest.source = index;
+            frames.push_back(newest);
+        }
+        // an unplugged camera fails its DQBUF, the file stand-in runs out of frames
+        if (source->ended)
+        {
+            epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, source->fd, nullptr);
+            this->active--;
+        }
+    }
+    return this->active > 0 || !frames.empty();
+}
+
+bool raw_frame_yuv_layout(const RawFrame& raw, YuvLayout& layout)
+{
+    if (raw.fourcc == V4L2_PIX_FMT_YUYV)
+        layout = YUV_YUYV;
+    else if (raw.fourcc == V4L2_PIX_FMT_NV12)
+        layout = YUV_NV12;
+    else if (raw.fourcc == V4L2_PIX_FMT_YUV420)
+        layout = YUV_I420;
+    else
+        return false;
+    return true;
+}
+
+void raw_frame_to_bgr(const RawFrame& raw, cv::Mat& bgr)
+{
+    if (raw.fourcc == V4L2_PIX_FMT_MJPEG)
+        bgr = cv::imdecode(raw.data, cv::IMREAD_COLOR);
+    else if (raw.fourcc == V4L2_PIX_FMT_NV12)
+        cv::cvtColor(raw.data, bgr, cv::COLOR_YUV2BGR_NV12);
+    else if (raw.fourcc == V4L2_PIX_FMT_YUV420)
+        cv::cvtColor(raw.data, bgr, cv::COLOR_YUV2BGR_I420);
+    else
+        cv::cvtColor(raw.data, bgr, cv::COLOR_YUV2BGR_YUYV);
+}
+
+cv::Mat raw_frame_motion_view(const RawFrame& raw)
+{
+    if (raw.fourcc == V4L2_PIX_FMT_MJPEG)
+        return cv::imdecode(raw.data, cv::IMREAD_REDUCED_GRAYSCALE_8);
+    if (is_planar_420(raw.fourcc))
+        return raw.data.rowRange(0, raw.height);
+    return raw.data;
+}
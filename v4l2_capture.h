@@ -0,0 +1,82 @@
+#ifndef V4L2_CAPTURE_H
+#define V4L2_CAPTURE_H
+
+#include <opencv2/core/core.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "letterbox.h"
+
+struct V4l2CameraConfig
+{
+    // a V4L2 capture node (/dev/videoN, vivid works too) or a file of raw frames played back as a
+    // stand-in camera: width x height frames of pixel_format stored one after the other
+    std::string device;
+    int width = 1280;
+    int height = 720;
+    std::string pixel_format = "YUYV"; // YUYV, NV12, YU12 (I420) or MJPG, the file stand-in plays the raw ones
+    int fps = 30;
+    int buffers = 8; // driver buffers, frames held anywhere in the pipeline keep theirs
+    bool loop = false; // the file stand-in starts over at its end instead of ending the capture
+};
+
+class FrameSource;
+
+// a captured frame left in the buffer the driver wrote it to. data is a header over the mapped
+// buffer, nothing is copied; the buffer goes back to the driver once the last RawFrame sharing the
+// lease is gone, so a frame must not be held longer than the pipeline needs it.
+struct RawFrame
+{
+    cv::Mat data; // YUYV: height x width CV_8UC2, NV12/YU12: (height * 3 / 2) x width CV_8UC1, MJPG: 1 x size CV_8UC1
+    uint32_t fourcc = 0;
+    int width = 0;
+    int height = 0;
+    int source = -1; // index of the device in the V4l2Capture
+    uint32_t sequence = 0; // frame counter of the driver
+    std::shared_ptr<void> lease;
+
+    bool empty() const { return this->data.empty(); }
+};
+
+// streams from several devices at once with one epoll loop: every device is a V4L2 node mapped in
+// mmap streaming mode (or a file played at its fps through a timerfd), wait_frames hands out the
+// newest frame of each device which has one ready. Only the thread calling wait_frames may use the
+// capture, the frames it returns can be passed to and released on any thread.
+class V4l2Capture
+{
+public:
+    V4l2Capture();
+    ~V4l2Capture();
+
+    // opens the device and starts streaming, returns its index or -1
+    int add_device(const V4l2CameraConfig& config);
+    int size() const { return (int)this->sources.size(); }
+
+    // waits up to timeout_ms and fills frames with the newest frame of every ready device, the older
+    // frames queued by the driver meanwhile are given back unused. false once every device has ended
+    bool wait_frames(std::vector<RawFrame>& frames, int timeout_ms);
+
+private:
+    int epoll_fd;
+    std::vector<std::shared_ptr<FrameSource> > sources;
+    int active;
+
+    V4l2Capture(const V4l2Capture&);
+    V4l2Capture& operator=(const V4l2Capture&);
+};
+
+// "YUYV" -> V4L2_PIX_FMT_YUYV
+uint32_t fourcc_from_string(const std::string& name);
+
+// the layout of the raw frame for NanoDet::detect_frame, false for MJPG which has to be decoded first
+bool raw_frame_yuv_layout(const RawFrame& raw, YuvLayout& layout);
+
+// the frame as a BGR image, a conversion at full camera resolution only the display should need
+void raw_frame_to_bgr(const RawFrame& raw, cv::Mat& bgr);
+
+// an image the motion gate can score without a full colour conversion: the YUYV frame itself (luma
+// in channel 0), the luma plane of NV12/YU12 or a 1/8 scale grayscale decode of the MJPG frame
+cv::Mat raw_frame_motion_view(const RawFrame& raw);
+
+#endif //V4L2_CAPTURE_H